@@ -0,0 +1,151 @@
+/*
+ * Listing the PIDs in /proc: procfs_list_pids() against the opendir() /
+ * readdir() / strtol() walk it replaced. Idle children are forked first
+ * so that /proc holds a known number of extra tasks. The getdents64 calls
+ * of one scan are counted by tracing a child that runs it.
+ *
+ * usage: bench_pidscan [children] [rounds]
+ */
+#define _GNU_SOURCE
+
+#include <ctype.h>
+#include <dirent.h>
+#include <stdio.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <sys/ptrace.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "procfs.h"
+
+static double monotonic_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+/* The walk procfs_list_pids() replaced: opendir() and readdir() over
+ * /proc, with strtol() on every name that starts with a digit. */
+static size_t list_pids_readdir(void) {
+    DIR *dir = opendir("/proc");
+    if (!dir)
+        return 0;
+    size_t count = 0;
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL) {
+        if (!isdigit((unsigned char)entry->d_name[0]))
+            continue;
+        char *end = NULL;
+        long pid = strtol(entry->d_name, &end, 10);
+        if (end && *end == '\0' && pid > 0)
+            count++;
+    }
+    closedir(dir);
+    return count;
+}
+
+static size_t list_pids_procfs(void) {
+    procfs_pid_scan scan;
+    procfs_pid_scan_init(&scan);
+    size_t count = procfs_list_pids(&scan) == 0 ? scan.count : 0;
+    procfs_pid_scan_free(&scan);
+    return count;
+}
+
+/* getdents64 calls made by one walk, or -1 where ptrace is not allowed. */
+static long count_getdents64(size_t (*walk)(void)) {
+    pid_t child = fork();
+    if (child < 0)
+        return -1;
+    if (child == 0) {
+        if (ptrace(PTRACE_TRACEME, 0, NULL, NULL) != 0)
+            _exit(1);
+        raise(SIGSTOP);
+        walk();
+        _exit(0);
+    }
+    int status;
+    if (waitpid(child, &status, 0) != child || !WIFSTOPPED(status)) {
+        waitpid(child, NULL, 0);
+        return -1;
+    }
+    ptrace(PTRACE_SETOPTIONS, child, NULL, PTRACE_O_TRACESYSGOOD | PTRACE_O_EXITKILL);
+    long calls = 0;
+    while (ptrace(PTRACE_SYSCALL, child, NULL, NULL) == 0 && waitpid(child, &status, 0) == child &&
+           WIFSTOPPED(status)) {
+        if (WSTOPSIG(status) != (SIGTRAP | 0x80))
+            continue;
+        struct __ptrace_syscall_info info;
+        if (ptrace(PTRACE_GET_SYSCALL_INFO, child, sizeof(info), &info) > 0 &&
+            info.op == PTRACE_SYSCALL_INFO_ENTRY && info.entry.nr == SYS_getdents64)
+            calls++;
+    }
+    kill(child, SIGKILL);
+    waitpid(child, NULL, 0);
+    return calls;
+}
+
+int main(int argc, char *argv[]) {
+    long children = argc > 1 ? strtol(argv[1], NULL, 10) : 1000;
+    long rounds = argc > 2 ? strtol(argv[2], NULL, 10) : 2000;
+
+    /* the children exit when the pipe closes */
+    int gate[2];
+    if (pipe(gate) != 0) {
+        perror("pipe");
+        return 1;
+    }
+    long forked = 0;
+    for (; forked < children; ++forked) {
+        pid_t pid = fork();
+        if (pid < 0)
+            break;
+        if (pid == 0) {
+            char byte;
+            close(gate[1]);
+            while (read(gate[0], &byte, 1) < 0)
+                ;
+            _exit(0);
+        }
+    }
+    close(gate[0]);
+
+    procfs_pid_scan scan;
+    procfs_pid_scan_init(&scan);
+    if (procfs_list_pids(&scan) != 0) {
+        perror("procfs_list_pids");
+        return 1;
+    }
+    size_t tasks = scan.count;
+
+    volatile size_t sink = 0;
+    double start = monotonic_seconds();
+    for (long r = 0; r < rounds; ++r)
+        sink += list_pids_readdir();
+    double readdir_us = (monotonic_seconds() - start) * 1e6 / (double)rounds;
+
+    start = monotonic_seconds();
+    for (long r = 0; r < rounds; ++r) {
+        procfs_list_pids(&scan);
+        sink += scan.count;
+    }
+    double getdents_us = (monotonic_seconds() - start) * 1e6 / (double)rounds;
+
+    long readdir_calls = count_getdents64(list_pids_readdir);
+    long getdents_calls = count_getdents64(list_pids_procfs);
+
+    close(gate[1]);
+    while (wait(NULL) > 0)
+        ;
+    procfs_pid_scan_free(&scan);
+
+    printf("/proc scan, %zu PIDs (%ld forked) x %ld rounds\n", tasks, forked, rounds);
+    printf("                                  us/scan  getdents64/scan\n");
+    printf("  opendir + readdir + strtol     %8.1f  %15ld\n", readdir_us, readdir_calls);
+    printf("  procfs_list_pids               %8.1f  %15ld\n", getdents_us, getdents_calls);
+    (void)sink;
+    return 0;
+}
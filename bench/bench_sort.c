@@ -0,0 +1,191 @@
+/*
+ * Full sorts of a synthetic process table: qsort_r() of the row indices
+ * with the per-key comparators of process_list_ensure_sorted() against
+ * qsort() of process_info rows with the strcasecmp-dispatched comparator
+ * that they replaced. Both start from PID order, as /proc lists the
+ * processes and as process_list_ensure_sorted() hands the rows over. Only
+ * the sort is timed, not the tree linking that follows it.
+ *
+ * usage: bench_sort [rows...]
+ */
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <time.h>
+
+#include "config.h"
+#include "process.h"
+
+#define RUNS 20
+
+static const char *const names[] = {
+    "systemd", "kworker/0:1", "postgres: walwriter", "nginx: worker", "bash", "sshd",
+    "java", "python3", "containerd", "Web Content", "cron", "node", "zsh", "vim",
+};
+
+static double monotonic_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+static unsigned int next_random(unsigned int *state) {
+    *state = *state * 1103515245u + 12345u;
+    return *state >> 8;
+}
+
+/* The single comparator the per-key ones replaced: the key is a global
+ * string, resolved with strcasecmp() inside every comparison. */
+static const char *g_sort_key = "cpu";
+
+static int double_cmp(double a, double b) {
+    return (a > b) - (a < b);
+}
+
+static int process_compare(const void *lhs, const void *rhs) {
+    const process_info *a = lhs;
+    const process_info *b = rhs;
+    if (strcasecmp(g_sort_key, "cpu") == 0)
+        return double_cmp(b->cpu_percent, a->cpu_percent);
+    if (strcasecmp(g_sort_key, "memory") == 0 || strcasecmp(g_sort_key, "mem") == 0)
+        return double_cmp(b->mem_percent, a->mem_percent);
+    if (strcasecmp(g_sort_key, "pid") == 0)
+        return (a->pid > b->pid) - (a->pid < b->pid);
+    if (strcasecmp(g_sort_key, "name") == 0 || strcasecmp(g_sort_key, "command") == 0)
+        return strcasecmp(a->command, b->command);
+    return double_cmp(b->cpu_percent, a->cpu_percent);
+}
+
+typedef struct {
+    process_list list;
+    intern_pool strings;
+    process_info *items;  /* the same rows for the old comparator */
+    process_info *scratch;
+} table;
+
+/* Mostly idle rows, as on a real host: 90% at 0.0% CPU. */
+static int table_fill(table *t, size_t rows) {
+    process_list *list = &t->list;
+    memset(t, 0, sizeof(*t));
+    intern_pool_init(&t->strings);
+    list->pid = calloc(rows, sizeof(pid_t));
+    list->ppid = calloc(rows, sizeof(pid_t));
+    list->cpu_percent = calloc(rows, sizeof(double));
+    list->mem_percent = calloc(rows, sizeof(double));
+    list->rss_kb = calloc(rows, sizeof(long));
+    list->detail = calloc(rows, sizeof(process_detail));
+    list->order = calloc(rows, sizeof(size_t));
+    list->parent = calloc(rows, sizeof(size_t));
+    list->first_child = calloc(rows, sizeof(size_t));
+    list->next_sibling = calloc(rows, sizeof(size_t));
+    t->items = calloc(rows, sizeof(process_info));
+    t->scratch = calloc(rows, sizeof(process_info));
+    if (!list->pid || !list->ppid || !list->cpu_percent || !list->mem_percent || !list->rss_kb ||
+        !list->detail || !list->order || !list->parent || !list->first_child ||
+        !list->next_sibling || !t->items || !t->scratch)
+        return -1;
+    list->rows = list->count = list->capacity = rows;
+    list->strings = &t->strings;
+
+    unsigned int seed = 42;
+    for (size_t row = 0; row < rows; ++row) {
+        process_info *info = &t->items[row];
+        info->pid = (pid_t)(row * 3 + 1);
+        info->cpu_percent = next_random(&seed) % 10 == 0 ? (next_random(&seed) % 10000) / 100.0 : 0.0;
+        info->mem_percent = (next_random(&seed) % 2000) / 100.0;
+        info->rss_kb = (long)(next_random(&seed) % 4000000);
+        info->cpu_time = (next_random(&seed) % 100000) / 10.0;
+        snprintf(info->command, sizeof(info->command), "%s",
+                 names[next_random(&seed) % (sizeof(names) / sizeof(names[0]))]);
+
+        list->pid[row] = info->pid;
+        list->cpu_percent[row] = info->cpu_percent;
+        list->mem_percent[row] = info->mem_percent;
+        list->rss_kb[row] = info->rss_kb;
+        list->detail[row].cpu_time = info->cpu_time;
+        if (intern_acquire(&t->strings, info->command, &list->detail[row].command) != 0)
+            return -1;
+        list->parent[row] = PROCESS_ROW_NONE;
+    }
+    return intern_update_ranks(&t->strings);
+}
+
+static void table_free(table *t) {
+    process_list *list = &t->list;
+    free(list->pid);
+    free(list->ppid);
+    free(list->cpu_percent);
+    free(list->mem_percent);
+    free(list->rss_kb);
+    free(list->detail);
+    free(list->order);
+    free(list->parent);
+    free(list->first_child);
+    free(list->next_sibling);
+    free(t->items);
+    free(t->scratch);
+    intern_pool_free(&t->strings);
+}
+
+/* Best of RUNS, in milliseconds. */
+static double time_per_key(table *t, sort_key_t key) {
+    cupid_config config = {0}; /* only the sort fields are read */
+    config.sort_key = key;
+    process_comparator cmp = process_list_comparator(&config);
+    size_t rows = t->list.rows;
+    double best = 1e9;
+    for (int run = 0; run < RUNS; ++run) {
+        for (size_t row = 0; row < rows; ++row)
+            t->list.order[row] = row;
+        double start = monotonic_seconds();
+        qsort_r(t->list.order, rows, sizeof(size_t), cmp, &t->list);
+        double elapsed = monotonic_seconds() - start;
+        if (elapsed < best)
+            best = elapsed;
+    }
+    return best * 1e3;
+}
+
+static double time_old_compare(table *t, const char *key) {
+    g_sort_key = key;
+    size_t rows = t->list.rows;
+    double best = 1e9;
+    for (int run = 0; run < RUNS; ++run) {
+        memcpy(t->scratch, t->items, rows * sizeof(process_info));
+        double start = monotonic_seconds();
+        qsort(t->scratch, rows, sizeof(process_info), process_compare);
+        double elapsed = monotonic_seconds() - start;
+        if (elapsed < best)
+            best = elapsed;
+    }
+    return best * 1e3;
+}
+
+int main(int argc, char *argv[]) {
+    size_t defaults[] = {10000, 50000};
+    size_t count = argc > 1 ? (size_t)(argc - 1) : 2;
+    printf("full sort, best of %d (ms)        strcasecmp  per-key\n", RUNS);
+    for (size_t i = 0; i < count; ++i) {
+        size_t rows = argc > 1 ? strtoul(argv[i + 1], NULL, 10) : defaults[i];
+        table t;
+        if (rows == 0 || table_fill(&t, rows) != 0) {
+            fprintf(stderr, "cannot build %zu rows\n", rows);
+            return 1;
+        }
+        printf("  %6zu rows  cpu                 %8.2f  %7.2f\n", rows,
+               time_old_compare(&t, "cpu"), time_per_key(&t, SORT_KEY_CPU));
+        printf("  %6zu rows  memory              %8.2f  %7.2f\n", rows,
+               time_old_compare(&t, "memory"), time_per_key(&t, SORT_KEY_MEM));
+        printf("  %6zu rows  name                %8.2f  %7.2f\n", rows,
+               time_old_compare(&t, "name"), time_per_key(&t, SORT_KEY_NAME));
+        printf("  %6zu rows  rss                        -  %7.2f\n", rows,
+               time_per_key(&t, SORT_KEY_RSS));
+        printf("  %6zu rows  time                       -  %7.2f\n", rows,
+               time_per_key(&t, SORT_KEY_TIME));
+        table_free(&t);
+    }
+    return 0;
+}
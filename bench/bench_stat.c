@@ -0,0 +1,131 @@
+/*
+ * procfs_parse_stat() against the strtok_r()/strtoull() parser it
+ * replaced, over a fixed corpus of /proc/<pid>/stat lines.
+ *
+ * usage: bench_stat <corpus> [rounds]
+ */
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "procfs.h"
+
+#define MAX_LINES 256
+
+static double monotonic_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+/* The parser procfs_parse_stat() replaced: strtol for the pid, strrchr
+ * for comm, then strtok_r over a copy of the rest. */
+static int parse_stat_strtok(const char *line, proc_stat_fields *out, char *scratch, size_t size) {
+    snprintf(scratch, size, "%s", line);
+    char *ptr = scratch;
+    out->pid = (pid_t)strtol(ptr, &ptr, 10);
+    while (*ptr == ' ')
+        ptr++;
+    if (*ptr != '(')
+        return -1;
+    ptr++;
+    char *comm_end = strrchr(ptr, ')');
+    if (!comm_end)
+        return -1;
+    out->comm = ptr;
+    out->comm_len = (size_t)(comm_end - ptr);
+    ptr = comm_end + 2;
+
+    int field_index = 3;
+    char *saveptr = NULL;
+    for (char *token = strtok_r(ptr, " ", &saveptr); token;
+         token = strtok_r(NULL, " ", &saveptr), field_index++) {
+        switch (field_index) {
+            case 3: out->state = token[0]; break;
+            case 4: out->ppid = (pid_t)strtol(token, NULL, 10); break;
+            case 14: out->utime = strtoull(token, NULL, 10); break;
+            case 15: out->stime = strtoull(token, NULL, 10); break;
+            case 20: out->num_threads = strtol(token, NULL, 10); break;
+            case 22: out->starttime = strtoull(token, NULL, 10); break;
+            case 23: out->vsize = strtoull(token, NULL, 10); break;
+            case 24: out->rss = strtoll(token, NULL, 10); break;
+            default: break;
+        }
+    }
+    return 0;
+}
+
+static bool same_fields(const proc_stat_fields *a, const proc_stat_fields *b) {
+    return a->pid == b->pid && a->comm_len == b->comm_len &&
+           memcmp(a->comm, b->comm, a->comm_len) == 0 && a->state == b->state &&
+           a->ppid == b->ppid && a->utime == b->utime && a->stime == b->stime &&
+           a->num_threads == b->num_threads && a->starttime == b->starttime &&
+           a->vsize == b->vsize && a->rss == b->rss;
+}
+
+int main(int argc, char *argv[]) {
+    if (argc < 2) {
+        fprintf(stderr, "usage: %s <corpus> [rounds]\n", argv[0]);
+        return 2;
+    }
+    long rounds = argc > 2 ? strtol(argv[2], NULL, 10) : 20000;
+    FILE *fp = fopen(argv[1], "r");
+    if (!fp) {
+        perror(argv[1]);
+        return 1;
+    }
+    static char lines[MAX_LINES][1024];
+    size_t lengths[MAX_LINES];
+    size_t count = 0;
+    while (count < MAX_LINES && fgets(lines[count], sizeof(lines[count]), fp)) {
+        lengths[count] = strcspn(lines[count], "\n");
+        lines[count][lengths[count]] = '\0';
+        if (lengths[count] > 0)
+            count++;
+    }
+    fclose(fp);
+    if (count == 0) {
+        fprintf(stderr, "%s: no lines\n", argv[1]);
+        return 1;
+    }
+
+    char scratch[1024];
+    for (size_t i = 0; i < count; ++i) {
+        proc_stat_fields fast, slow;
+        if (procfs_parse_stat(lines[i], lengths[i], &fast) != 0 ||
+            parse_stat_strtok(lines[i], &slow, scratch, sizeof(scratch)) != 0 ||
+            !same_fields(&fast, &slow)) {
+            fprintf(stderr, "line %zu: parsers disagree\n", i + 1);
+            return 1;
+        }
+    }
+
+    volatile unsigned long long sink = 0;
+    proc_stat_fields fields;
+    double start = monotonic_seconds();
+    for (long r = 0; r < rounds; ++r) {
+        for (size_t i = 0; i < count; ++i) {
+            parse_stat_strtok(lines[i], &fields, scratch, sizeof(scratch));
+            sink += fields.utime;
+        }
+    }
+    double strtok_ns = (monotonic_seconds() - start) * 1e9 / ((double)rounds * (double)count);
+
+    start = monotonic_seconds();
+    for (long r = 0; r < rounds; ++r) {
+        for (size_t i = 0; i < count; ++i) {
+            procfs_parse_stat(lines[i], lengths[i], &fields);
+            sink += fields.utime;
+        }
+    }
+    double single_ns = (monotonic_seconds() - start) * 1e9 / ((double)rounds * (double)count);
+
+    printf("stat parse, %zu lines x %ld rounds\n", count, rounds);
+    printf("  strtok_r + strtoull   %8.1f ns/line\n", strtok_ns);
+    printf("  procfs_parse_stat     %8.1f ns/line\n", single_ns);
+    (void)sink;
+    return 0;
+}
@@ -17,6 +17,10 @@ static bool is_known_key(const char *key) {
         return false;
     static const char *known[] = {
         "refresh_rate",
+        "refresh_adaptive",
+        "refresh_min_ms",
+        "refresh_max_ms",
+        "refresh_change_threshold",
         "default_sort",
         "sort_reverse",
         "show_header",
@@ -43,6 +47,14 @@ static bool is_known_key(const char *key) {
         "network_enabled",
         "command_max_width",
         "cpu_group_mode",
+        "persistent_fds",
+        "fd_budget",
+        "scan_threads",
+        "proc_events",
+        "proc_events_rescan",
+        "smaps_budget_ms",
+        "scan_slice_ms",
+        "cpu_schedstat",
         NULL
     };
     for (const char **p = known; *p; ++p) {
@@ -116,9 +128,29 @@ static tree_view_mode_t parse_tree_mode(const char *value, tree_view_mode_t fall
     return fallback;
 }
 
-static bool validate_sort_key(const char *key) {
-    return (strcasecmp(key, "cpu") == 0 || strcasecmp(key, "memory") == 0 ||
-            strcasecmp(key, "pid") == 0 || strcasecmp(key, "name") == 0);
+bool config_parse_sort_key(const char *value, sort_key_t *out) {
+    static const struct {
+        const char *name;
+        sort_key_t key;
+    } keys[] = {
+        {"cpu", SORT_KEY_CPU},         {"memory", SORT_KEY_MEM},
+        {"mem", SORT_KEY_MEM},         {"pid", SORT_KEY_PID},
+        {"name", SORT_KEY_NAME},       {"command", SORT_KEY_NAME},
+        {"rss", SORT_KEY_RSS},         {"threads", SORT_KEY_THREADS},
+        {"time", SORT_KEY_TIME},       {"pss", SORT_KEY_PSS},
+        {"io_read", SORT_KEY_IO_READ}, {"io_write", SORT_KEY_IO_WRITE},
+        {"io_cancelled", SORT_KEY_IO_CANCELLED}, {"runq", SORT_KEY_RUNQ},
+    };
+    if (!value)
+        return false;
+    for (size_t i = 0; i < sizeof(keys) / sizeof(keys[0]); ++i) {
+        if (strcasecmp(value, keys[i].name) == 0) {
+            if (out)
+                *out = keys[i].key;
+            return true;
+        }
+    }
+    return false;
 }
 
 static bool validate_ui_layout(const char *layout) {
@@ -136,7 +168,12 @@ void config_apply_defaults(cupid_config *cfg) {
         return;
 
     cfg->refresh_rate_ms = 1000;
+    cfg->refresh_adaptive = false;
+    cfg->refresh_min_ms = 250;
+    cfg->refresh_max_ms = 5000;
+    cfg->refresh_change_threshold = 5;
     copy_string(cfg->default_sort, sizeof(cfg->default_sort), "cpu", "cpu");
+    cfg->sort_key = SORT_KEY_CPU;
     cfg->sort_reverse = false;
     cfg->show_header = true;
     cfg->color_enabled = true;
@@ -168,6 +205,15 @@ void config_apply_defaults(cupid_config *cfg) {
 
     cfg->command_max_width = -1;
     cfg->cpu_group_mode = CPU_GROUP_FLAT;
+
+    cfg->persistent_fds = false;
+    cfg->fd_budget = 768;
+    cfg->scan_threads = 1;
+    cfg->proc_events = false;
+    cfg->proc_events_rescan = 60;
+    cfg->smaps_budget_ms = 5;
+    cfg->scan_slice_ms = 0;
+    cfg->cpu_schedstat = false;
 }
 
 static void apply_overrides_from_conf(cupid_config *cfg, cupidconf_t *conf) {
@@ -177,8 +223,23 @@ static void apply_overrides_from_conf(cupid_config *cfg, cupidconf_t *conf) {
     if (value)
         cfg->refresh_rate_ms = parse_int(value, 100, 60000, cfg->refresh_rate_ms);
 
+    value = cupidconf_get(conf, "refresh_adaptive");
+    cfg->refresh_adaptive = parse_bool(value, cfg->refresh_adaptive);
+
+    value = cupidconf_get(conf, "refresh_min_ms");
+    if (value)
+        cfg->refresh_min_ms = parse_int(value, 50, 60000, cfg->refresh_min_ms);
+
+    value = cupidconf_get(conf, "refresh_max_ms");
+    if (value)
+        cfg->refresh_max_ms = parse_int(value, 50, 60000, cfg->refresh_max_ms);
+
+    value = cupidconf_get(conf, "refresh_change_threshold");
+    if (value)
+        cfg->refresh_change_threshold = parse_int(value, 1, 100, cfg->refresh_change_threshold);
+
     value = cupidconf_get(conf, "default_sort");
-    if (value && validate_sort_key(value))
+    if (value && config_parse_sort_key(value, &cfg->sort_key))
         copy_string(cfg->default_sort, sizeof(cfg->default_sort), value, cfg->default_sort);
 
     value = cupidconf_get(conf, "sort_reverse");
@@ -270,6 +331,35 @@ static void apply_overrides_from_conf(cupid_config *cfg, cupidconf_t *conf) {
         else
             cfg->cpu_group_mode = CPU_GROUP_FLAT;
     }
+
+    value = cupidconf_get(conf, "persistent_fds");
+    cfg->persistent_fds = parse_bool(value, cfg->persistent_fds);
+
+    value = cupidconf_get(conf, "fd_budget");
+    if (value)
+        cfg->fd_budget = parse_int(value, 3, 1000000, cfg->fd_budget);
+
+    value = cupidconf_get(conf, "scan_threads");
+    if (value)
+        cfg->scan_threads = parse_int(value, 0, 64, cfg->scan_threads);
+
+    value = cupidconf_get(conf, "proc_events");
+    cfg->proc_events = parse_bool(value, cfg->proc_events);
+
+    value = cupidconf_get(conf, "proc_events_rescan");
+    if (value)
+        cfg->proc_events_rescan = parse_int(value, 1, 100000, cfg->proc_events_rescan);
+
+    value = cupidconf_get(conf, "smaps_budget_ms");
+    if (value)
+        cfg->smaps_budget_ms = parse_int(value, 0, 1000, cfg->smaps_budget_ms);
+
+    value = cupidconf_get(conf, "scan_slice_ms");
+    if (value)
+        cfg->scan_slice_ms = parse_int(value, 0, 1000, cfg->scan_slice_ms);
+
+    value = cupidconf_get(conf, "cpu_schedstat");
+    cfg->cpu_schedstat = parse_bool(value, cfg->cpu_schedstat);
 }
 
 static int create_default_config(const char *path) {
@@ -300,9 +390,15 @@ static int create_default_config(const char *path) {
     fprintf(fp, "# Lines starting with # are comments\n\n");
     
     fprintf(fp, "# Refresh rate in milliseconds\n");
-    fprintf(fp, "refresh_rate = 1000\n\n");
+    fprintf(fp, "refresh_rate = 1000\n");
+    fprintf(fp, "# Adapt the refresh rate to how fast the system changes\n");
+    fprintf(fp, "refresh_adaptive = false\n");
+    fprintf(fp, "refresh_min_ms = 250\n");
+    fprintf(fp, "refresh_max_ms = 5000\n");
+    fprintf(fp, "refresh_change_threshold = 5\n\n");
     
-    fprintf(fp, "# Default sort column (cpu, memory, pid, name, command)\n");
+    fprintf(fp, "# Default sort column (cpu, memory, mem, pid, name, command, rss, threads, time,\n");
+    fprintf(fp, "# pss, io_read, io_write, io_cancelled, runq)\n");
     fprintf(fp, "default_sort = cpu\n");
     fprintf(fp, "sort_reverse = false\n\n");
     
@@ -338,6 +434,16 @@ static int create_default_config(const char *path) {
     fprintf(fp, "memory_show_cached = true\n");
     fprintf(fp, "memory_show_buffers = true\n\n");
     
+    fprintf(fp, "# Sampler Settings\n");
+    fprintf(fp, "persistent_fds = false\n");
+    fprintf(fp, "fd_budget = 768\n");
+    fprintf(fp, "scan_threads = 1\n");
+    fprintf(fp, "proc_events = false\n");
+    fprintf(fp, "proc_events_rescan = 60\n");
+    fprintf(fp, "smaps_budget_ms = 5\n");
+    fprintf(fp, "scan_slice_ms = 0\n");
+    fprintf(fp, "cpu_schedstat = false\n\n");
+    
     fprintf(fp, "# Future Features (not yet implemented)\n");
     fprintf(fp, "disk_enabled = false\n");
     fprintf(fp, "network_enabled = false\n");
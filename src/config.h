@@ -13,9 +13,30 @@ typedef enum {
     CPU_GROUP_AGGREGATE,
 } cpu_group_mode_t;
 
+typedef enum {
+    SORT_KEY_CPU = 0,
+    SORT_KEY_MEM,
+    SORT_KEY_PID,
+    SORT_KEY_NAME,
+    SORT_KEY_RSS,
+    SORT_KEY_THREADS,
+    SORT_KEY_TIME,
+    SORT_KEY_PSS,
+    SORT_KEY_IO_READ,
+    SORT_KEY_IO_WRITE,
+    SORT_KEY_IO_CANCELLED,
+    SORT_KEY_RUNQ,
+    SORT_KEY_COUNT
+} sort_key_t;
+
 typedef struct cupid_config {
     int refresh_rate_ms;
+    bool refresh_adaptive;        /* move the rate between the bounds below */
+    int refresh_min_ms;
+    int refresh_max_ms;
+    int refresh_change_threshold; /* percentage points that count as a change */
     char default_sort[16];
+    sort_key_t sort_key; /* default_sort resolved once at load */
     bool sort_reverse;
     bool show_header;
     bool color_enabled;
@@ -46,9 +67,19 @@ typedef struct cupid_config {
 
     int command_max_width; /* 0 = auto, -1 = auto reserve for trailing columns */
     cpu_group_mode_t cpu_group_mode; /* how to interpret CPU in tree view */
+
+    bool persistent_fds; /* keep /proc/<pid> files open between refreshes */
+    int fd_budget;       /* max descriptors held open by persistent_fds */
+    int scan_threads;    /* /proc sampling workers, 0 = one per online CPU */
+    bool proc_events;    /* track PIDs via the netlink proc connector */
+    int proc_events_rescan; /* refreshes between reconciling /proc walks */
+    int smaps_budget_ms; /* time per refresh for smaps_rollup reads */
+    int scan_slice_ms;   /* incremental scan time per UI tick, 0 = full refreshes */
+    bool cpu_schedstat;  /* CPU% from /proc/<pid>/schedstat nanoseconds instead of ticks */
 } cupid_config;
 
 void config_apply_defaults(cupid_config *cfg);
 int config_load(cupid_config *cfg, const char *path);
 const char *tree_view_mode_to_string(tree_view_mode_t mode);
+bool config_parse_sort_key(const char *value, sort_key_t *out);
 
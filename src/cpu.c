@@ -402,6 +402,38 @@ void cpu_info_free(cpu_info_t *info) {
     info->core_freqs = NULL;
 }
 
+static int copy_core_values(double **dst, const double *src, int count) {
+    if (!src || count <= 0) {
+        free(*dst);
+        *dst = NULL;
+        return 0;
+    }
+    double *values = realloc(*dst, (size_t)count * sizeof(double));
+    if (!values)
+        return -1;
+    memcpy(values, src, (size_t)count * sizeof(double));
+    *dst = values;
+    return 0;
+}
+
+// Deep copy, for handing the panels to another thread
+int cpu_info_copy(cpu_info_t *dst, const cpu_info_t *src) {
+    if (!dst || !src)
+        return -1;
+    double *usage = dst->core_usage;
+    double *temps = dst->core_temps;
+    double *freqs = dst->core_freqs;
+    *dst = *src;
+    dst->core_usage = usage;
+    dst->core_temps = temps;
+    dst->core_freqs = freqs;
+    if (copy_core_values(&dst->core_usage, src->core_usage, src->logical_cores) != 0 ||
+        copy_core_values(&dst->core_temps, src->core_temps, src->logical_cores) != 0 ||
+        copy_core_values(&dst->core_freqs, src->core_freqs, src->logical_cores) != 0)
+        return -1;
+    return 0;
+}
+
 int read_full_cpu_info(cpu_info_t *info) {
     if (!info)
         return -1;
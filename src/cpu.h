@@ -18,6 +18,7 @@ typedef struct {
 // CPU info management
 void cpu_info_init(cpu_info_t *info);
 void cpu_info_free(cpu_info_t *info);
+int cpu_info_copy(cpu_info_t *dst, const cpu_info_t *src);
 
 // CPU data reading
 int read_full_cpu_info(cpu_info_t *info);
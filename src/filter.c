@@ -0,0 +1,551 @@
+#define _GNU_SOURCE
+
+#include "filter.h"
+
+#include <ctype.h>
+#include <fnmatch.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+#define FILTER_MAX_DEPTH 32
+#define FILTER_STACK_SIZE 64 /* results filter_eval() holds at once */
+
+typedef enum {
+    FIELD_PID,
+    FIELD_PPID,
+    FIELD_STATE,
+    FIELD_RSS,
+    FIELD_VMS,
+    FIELD_TIME,
+    FIELD_NAME,
+    FIELD_UID,
+    FIELD_THREADS,
+    FIELD_SWAP,
+    FIELD_VCSW,
+    FIELD_NVCSW,
+    FIELD_NSPID,
+    FIELD_CPU,
+    FIELD_MEM,
+    FIELD_USER,
+    FIELD_COMMAND,
+} filter_field;
+
+typedef enum {
+    VALUE_NUMBER,
+    VALUE_SIZE, /* kB, accepts K/M/G suffixes */
+    VALUE_STRING,
+} value_kind;
+
+static const struct {
+    const char *name;
+    filter_field field;
+    value_kind kind;
+    unsigned int stage;
+    unsigned int proc_fields;
+} fields[] = {
+    {"pid", FIELD_PID, VALUE_NUMBER, FILTER_STAGE_STAT, 0},
+    {"ppid", FIELD_PPID, VALUE_NUMBER, FILTER_STAGE_STAT, 0},
+    {"state", FIELD_STATE, VALUE_STRING, FILTER_STAGE_STAT, 0},
+    {"rss", FIELD_RSS, VALUE_SIZE, FILTER_STAGE_STAT, 0},
+    {"vms", FIELD_VMS, VALUE_SIZE, FILTER_STAGE_STAT, 0},
+    {"time", FIELD_TIME, VALUE_NUMBER, FILTER_STAGE_STAT, 0},
+    {"name", FIELD_NAME, VALUE_STRING, FILTER_STAGE_STAT, 0},
+    {"uid", FIELD_UID, VALUE_NUMBER, FILTER_STAGE_STATUS, PROC_FIELD_STATUS},
+    {"threads", FIELD_THREADS, VALUE_NUMBER, FILTER_STAGE_STATUS, PROC_FIELD_STATUS},
+    {"swap", FIELD_SWAP, VALUE_SIZE, FILTER_STAGE_STATUS, PROC_FIELD_STATUS},
+    {"vcsw", FIELD_VCSW, VALUE_NUMBER, FILTER_STAGE_STATUS, PROC_FIELD_STATUS},
+    {"nvcsw", FIELD_NVCSW, VALUE_NUMBER, FILTER_STAGE_STATUS, PROC_FIELD_STATUS},
+    {"nspid", FIELD_NSPID, VALUE_NUMBER, FILTER_STAGE_STATUS, PROC_FIELD_STATUS},
+    {"cpu", FIELD_CPU, VALUE_NUMBER, FILTER_STAGE_MERGE, 0},
+    {"mem", FIELD_MEM, VALUE_NUMBER, FILTER_STAGE_MERGE, 0},
+    {"user", FIELD_USER, VALUE_STRING, FILTER_STAGE_MERGE, PROC_FIELD_USER | PROC_FIELD_STATUS},
+    {"command", FIELD_COMMAND, VALUE_STRING, FILTER_STAGE_MERGE, PROC_FIELD_CMDLINE},
+};
+
+#define FIELD_COUNT (sizeof(fields) / sizeof(fields[0]))
+
+typedef enum {
+    OP_EQ,
+    OP_NE,
+    OP_LT,
+    OP_LE,
+    OP_GT,
+    OP_GE,
+    OP_GLOB,
+    OP_NOT_GLOB,
+} filter_op;
+
+typedef struct {
+    size_t field; /* index into fields[] */
+    filter_op op;
+    double number;
+    char *text;
+} filter_term;
+
+typedef enum {
+    INSN_TERM,
+    INSN_AND,
+    INSN_OR,
+    INSN_NOT,
+} insn_kind;
+
+typedef struct {
+    insn_kind kind;
+    size_t term;
+} filter_insn;
+
+struct process_filter {
+    filter_term *terms;
+    size_t term_count;
+    filter_insn *program; /* postfix */
+    size_t length;
+    size_t capacity;
+    unsigned int proc_fields;
+};
+
+typedef struct {
+    const char *p;
+    process_filter *filter;
+    char *err;
+    size_t errlen;
+    int depth;
+    size_t stack; /* results the program emitted so far leaves on the stack */
+} parser;
+
+static int fail(parser *ps, const char *what) {
+    if (ps->err && ps->errlen > 0)
+        snprintf(ps->err, ps->errlen, "%s near \"%.16s\"", what, ps->p);
+    return -1;
+}
+
+static int emit(parser *ps, insn_kind kind, size_t term) {
+    process_filter *f = ps->filter;
+    /* rejected here rather than left to filter_eval(), which could only
+     * answer FILTER_UNKNOWN for every process */
+    if (kind == INSN_TERM && ++ps->stack > FILTER_STACK_SIZE)
+        return fail(ps, "too deeply nested");
+    if (kind == INSN_AND || kind == INSN_OR)
+        ps->stack--;
+    if (f->length == f->capacity) {
+        size_t new_cap = f->capacity ? f->capacity * 2 : 16;
+        filter_insn *program = realloc(f->program, new_cap * sizeof(filter_insn));
+        if (!program)
+            return fail(ps, "out of memory");
+        f->program = program;
+        f->capacity = new_cap;
+    }
+    f->program[f->length].kind = kind;
+    f->program[f->length].term = term;
+    f->length++;
+    return 0;
+}
+
+static void skip_space(parser *ps) {
+    while (isspace((unsigned char)*ps->p))
+        ps->p++;
+}
+
+static bool accept(parser *ps, const char *token) {
+    skip_space(ps);
+    size_t len = strlen(token);
+    if (strncmp(ps->p, token, len) != 0)
+        return false;
+    /* keywords must end at a word boundary */
+    if (isalpha((unsigned char)token[0]) && isalnum((unsigned char)ps->p[len]))
+        return false;
+    ps->p += len;
+    return true;
+}
+
+/* Reads a quoted string or a run up to whitespace or ')'. */
+static char *read_value(parser *ps) {
+    skip_space(ps);
+    const char *start = ps->p;
+    size_t len;
+    if (*ps->p == '"' || *ps->p == '\'') {
+        char quote = *ps->p++;
+        start = ps->p;
+        while (*ps->p && *ps->p != quote)
+            ps->p++;
+        if (*ps->p != quote)
+            return NULL;
+        len = (size_t)(ps->p - start);
+        ps->p++;
+    } else {
+        while (*ps->p && !isspace((unsigned char)*ps->p) && *ps->p != ')' && *ps->p != '&' &&
+               *ps->p != '|')
+            ps->p++;
+        len = (size_t)(ps->p - start);
+        if (len == 0)
+            return NULL;
+    }
+    return strndup(start, len);
+}
+
+static int parse_number(const char *text, value_kind kind, double *out) {
+    char *end = NULL;
+    double v = strtod(text, &end);
+    if (end == text)
+        return -1;
+    if (kind == VALUE_SIZE && *end) {
+        switch (toupper((unsigned char)*end)) {
+            case 'K':
+                break;
+            case 'M':
+                v *= 1024.0;
+                break;
+            case 'G':
+                v *= 1024.0 * 1024.0;
+                break;
+            default:
+                return -1;
+        }
+        end++;
+        if (toupper((unsigned char)*end) == 'B')
+            end++;
+    }
+    if (*end == '%')
+        end++;
+    if (*end)
+        return -1;
+    *out = v;
+    return 0;
+}
+
+static int add_term(parser *ps, filter_term *term) {
+    process_filter *f = ps->filter;
+    filter_term *terms = realloc(f->terms, (f->term_count + 1) * sizeof(filter_term));
+    if (!terms) {
+        free(term->text);
+        return fail(ps, "out of memory");
+    }
+    f->terms = terms;
+    f->terms[f->term_count] = *term;
+    f->proc_fields |= fields[term->field].proc_fields;
+    return emit(ps, INSN_TERM, f->term_count++);
+}
+
+static int parse_term(parser *ps) {
+    skip_space(ps);
+    const char *start = ps->p;
+    while (isalnum((unsigned char)*ps->p) || *ps->p == '_')
+        ps->p++;
+    size_t name_len = (size_t)(ps->p - start);
+
+    filter_term term = {0};
+    static const struct {
+        const char *token;
+        filter_op op;
+    } ops[] = {
+        {"!~", OP_NOT_GLOB}, {"!=", OP_NE}, {"<=", OP_LE}, {">=", OP_GE},
+        {"==", OP_EQ},       {"=", OP_EQ},  {"<", OP_LT},  {">", OP_GT}, {"~", OP_GLOB},
+    };
+    bool have_op = false;
+    skip_space(ps);
+    for (size_t i = 0; i < sizeof(ops) / sizeof(ops[0]) && name_len > 0; ++i) {
+        size_t len = strlen(ops[i].token);
+        if (strncmp(ps->p, ops[i].token, len) == 0) {
+            term.op = ops[i].op;
+            ps->p += len;
+            have_op = true;
+            break;
+        }
+    }
+
+    if (!have_op) {
+        /* a bare word searches the command line */
+        ps->p = start;
+        char *word = read_value(ps);
+        if (!word)
+            return fail(ps, "expected a term");
+        size_t len = strlen(word);
+        term.text = malloc(len + 3);
+        if (!term.text) {
+            free(word);
+            return fail(ps, "out of memory");
+        }
+        snprintf(term.text, len + 3, "*%s*", word);
+        free(word);
+        term.op = OP_GLOB;
+        for (size_t i = 0; i < FIELD_COUNT; ++i) {
+            if (fields[i].field == FIELD_COMMAND)
+                term.field = i;
+        }
+        return add_term(ps, &term);
+    }
+
+    size_t field = FIELD_COUNT;
+    for (size_t i = 0; i < FIELD_COUNT; ++i) {
+        if (strlen(fields[i].name) == name_len && strncasecmp(fields[i].name, start, name_len) == 0)
+            field = i;
+    }
+    if (field == FIELD_COUNT) {
+        ps->p = start;
+        return fail(ps, "unknown field");
+    }
+    term.field = field;
+
+    char *value = read_value(ps);
+    if (!value)
+        return fail(ps, "expected a value");
+    if (fields[field].kind == VALUE_STRING) {
+        if (term.op != OP_EQ && term.op != OP_NE && term.op != OP_GLOB && term.op != OP_NOT_GLOB) {
+            free(value);
+            return fail(ps, "text fields only compare with = != ~ !~");
+        }
+        term.text = value;
+    } else {
+        if (term.op == OP_GLOB || term.op == OP_NOT_GLOB) {
+            free(value);
+            return fail(ps, "numeric fields do not match globs");
+        }
+        int rc = parse_number(value, fields[field].kind, &term.number);
+        free(value);
+        if (rc != 0)
+            return fail(ps, "bad number");
+    }
+    return add_term(ps, &term);
+}
+
+static int parse_or(parser *ps);
+
+static int parse_unary(parser *ps) {
+    if (accept(ps, "!") || accept(ps, "not")) {
+        if (parse_unary(ps) != 0)
+            return -1;
+        return emit(ps, INSN_NOT, 0);
+    }
+    if (accept(ps, "(")) {
+        if (++ps->depth > FILTER_MAX_DEPTH)
+            return fail(ps, "too deeply nested");
+        if (parse_or(ps) != 0)
+            return -1;
+        ps->depth--;
+        if (!accept(ps, ")"))
+            return fail(ps, "expected ')'");
+        return 0;
+    }
+    return parse_term(ps);
+}
+
+static bool at_term_start(parser *ps) {
+    skip_space(ps);
+    if (strncmp(ps->p, "or", 2) == 0 && !isalnum((unsigned char)ps->p[2]))
+        return false;
+    return *ps->p && *ps->p != ')' && *ps->p != '|';
+}
+
+static int parse_and(parser *ps) {
+    if (parse_unary(ps) != 0)
+        return -1;
+    for (;;) {
+        if (!accept(ps, "&&") && !accept(ps, "and")) {
+            /* juxtaposed terms are ANDed as well */
+            if (!at_term_start(ps))
+                return 0;
+        }
+        if (parse_unary(ps) != 0 || emit(ps, INSN_AND, 0) != 0)
+            return -1;
+    }
+}
+
+static int parse_or(parser *ps) {
+    if (parse_and(ps) != 0)
+        return -1;
+    while (accept(ps, "||") || accept(ps, "or")) {
+        if (parse_and(ps) != 0 || emit(ps, INSN_OR, 0) != 0)
+            return -1;
+    }
+    return 0;
+}
+
+process_filter *filter_compile(const char *expr, char *err, size_t errlen) {
+    if (err && errlen > 0)
+        err[0] = '\0';
+    if (!expr)
+        return NULL;
+    process_filter *filter = calloc(1, sizeof(*filter));
+    if (!filter)
+        return NULL;
+    parser ps = {expr, filter, err, errlen, 0, 0};
+    skip_space(&ps);
+    if (*ps.p == '\0') {
+        fail(&ps, "empty filter");
+        filter_free(filter);
+        return NULL;
+    }
+    if (parse_or(&ps) != 0) {
+        filter_free(filter);
+        return NULL;
+    }
+    skip_space(&ps);
+    if (*ps.p != '\0') {
+        fail(&ps, "unexpected text");
+        filter_free(filter);
+        return NULL;
+    }
+    return filter;
+}
+
+void filter_free(process_filter *filter) {
+    if (!filter)
+        return;
+    for (size_t i = 0; i < filter->term_count; ++i)
+        free(filter->terms[i].text);
+    free(filter->terms);
+    free(filter->program);
+    free(filter);
+}
+
+unsigned int filter_fields(const process_filter *filter) {
+    return filter ? filter->proc_fields : 0;
+}
+
+static double number_of(filter_field field, const process_info *info) {
+    switch (field) {
+        case FIELD_PID:
+            return info->pid;
+        case FIELD_PPID:
+            return info->ppid;
+        case FIELD_RSS:
+            return (double)info->rss_kb;
+        case FIELD_VMS:
+            return (double)info->vms_kb;
+        case FIELD_TIME:
+            return info->cpu_time;
+        case FIELD_UID:
+            return info->uid;
+        case FIELD_THREADS:
+            return info->threads;
+        case FIELD_SWAP:
+            return (double)info->swap_kb;
+        case FIELD_VCSW:
+            return (double)info->ctxt_voluntary;
+        case FIELD_NVCSW:
+            return (double)info->ctxt_involuntary;
+        case FIELD_NSPID:
+            return info->nspid;
+        case FIELD_CPU:
+            return info->cpu_percent;
+        case FIELD_MEM:
+            return info->mem_percent;
+        default:
+            return 0.0;
+    }
+}
+
+static filter_result eval_term(const filter_term *term, const filter_subject *subject) {
+    /* uid 0 and user "?" are placeholders, not values to match */
+    if (subject->status_unknown && (fields[term->field].proc_fields & PROC_FIELD_STATUS))
+        return FILTER_UNKNOWN;
+    filter_field field = fields[term->field].field;
+    if (fields[term->field].kind != VALUE_STRING) {
+        double v = number_of(field, subject->info);
+        bool r;
+        switch (term->op) {
+            case OP_EQ:
+                r = v == term->number;
+                break;
+            case OP_NE:
+                r = v != term->number;
+                break;
+            case OP_LT:
+                r = v < term->number;
+                break;
+            case OP_LE:
+                r = v <= term->number;
+                break;
+            case OP_GT:
+                r = v > term->number;
+                break;
+            case OP_GE:
+                r = v >= term->number;
+                break;
+            default:
+                r = false;
+                break;
+        }
+        return r ? FILTER_TRUE : FILTER_FALSE;
+    }
+
+    char state[2] = {subject->info->state, '\0'};
+    const char *text = NULL;
+    switch (field) {
+        case FIELD_STATE:
+            text = state;
+            break;
+        case FIELD_NAME:
+            text = subject->comm;
+            break;
+        case FIELD_USER:
+            text = subject->user;
+            break;
+        case FIELD_COMMAND:
+            text = subject->command;
+            break;
+        default:
+            break;
+    }
+    if (!text)
+        return FILTER_UNKNOWN;
+    bool r;
+    if (term->op == OP_GLOB || term->op == OP_NOT_GLOB)
+        r = fnmatch(term->text, text, FNM_CASEFOLD) == 0;
+    else
+        r = strcasecmp(term->text, text) == 0;
+    if (term->op == OP_NE || term->op == OP_NOT_GLOB)
+        r = !r;
+    return r ? FILTER_TRUE : FILTER_FALSE;
+}
+
+/* Kleene logic, so a verdict reached from early fields stands no matter
+ * what the later ones turn out to be. */
+filter_result filter_eval(const process_filter *filter, const filter_subject *subject,
+                          unsigned int stages) {
+    if (!filter || !subject || !subject->info)
+        return FILTER_TRUE;
+    filter_result stack[FILTER_STACK_SIZE]; /* filter_compile() keeps programs within it */
+    size_t top = 0;
+    for (size_t i = 0; i < filter->length; ++i) {
+        const filter_insn *insn = &filter->program[i];
+        switch (insn->kind) {
+            case INSN_TERM: {
+                const filter_term *term = &filter->terms[insn->term];
+                filter_result r = FILTER_UNKNOWN;
+                if (fields[term->field].stage & stages)
+                    r = eval_term(term, subject);
+                stack[top++] = r;
+                break;
+            }
+            case INSN_NOT:
+                if (stack[top - 1] != FILTER_UNKNOWN)
+                    stack[top - 1] = stack[top - 1] == FILTER_TRUE ? FILTER_FALSE : FILTER_TRUE;
+                break;
+            case INSN_AND: {
+                filter_result b = stack[--top];
+                filter_result a = stack[top - 1];
+                if (a == FILTER_FALSE || b == FILTER_FALSE)
+                    stack[top - 1] = FILTER_FALSE;
+                else if (a == FILTER_TRUE && b == FILTER_TRUE)
+                    stack[top - 1] = FILTER_TRUE;
+                else
+                    stack[top - 1] = FILTER_UNKNOWN;
+                break;
+            }
+            case INSN_OR: {
+                filter_result b = stack[--top];
+                filter_result a = stack[top - 1];
+                if (a == FILTER_TRUE || b == FILTER_TRUE)
+                    stack[top - 1] = FILTER_TRUE;
+                else if (a == FILTER_FALSE && b == FILTER_FALSE)
+                    stack[top - 1] = FILTER_FALSE;
+                else
+                    stack[top - 1] = FILTER_UNKNOWN;
+                break;
+            }
+        }
+    }
+    return top == 1 ? stack[0] : FILTER_UNKNOWN;
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "process.h"
+
+/* Process filter expressions, e.g.
+ *
+ *   user=postgres && cpu>5
+ *   command~nginx* || (state=D && !pid=1)
+ *   java                    (bare word: command contains "java")
+ *
+ * Terms are `field op value` with op one of = != < <= > >= ~ !~ (~ is a
+ * case-insensitive glob). Terms combine with &&, || (also `and`, `or`),
+ * ! and parentheses; adjacent terms are ANDed. Size fields accept K, M and
+ * G suffixes. An expression compiles once into a postfix program. */
+typedef struct process_filter process_filter;
+
+/* When each field becomes known during a refresh. A program evaluated
+ * before FILTER_STAGE_MERGE may answer FILTER_UNKNOWN. */
+enum {
+    FILTER_STAGE_STAT = 1u << 0,   /* pid, ppid, state, rss, vms, time, name */
+    FILTER_STAGE_STATUS = 1u << 1, /* uid, threads, swap, vcsw, nvcsw, nspid */
+    FILTER_STAGE_MERGE = 1u << 2,  /* cpu, mem, user, command */
+    FILTER_STAGE_ALL = FILTER_STAGE_STAT | FILTER_STAGE_STATUS | FILTER_STAGE_MERGE,
+};
+
+typedef enum {
+    FILTER_FALSE = 0,
+    FILTER_TRUE,
+    FILTER_UNKNOWN,
+} filter_result;
+
+/* Values a filter can look at. Strings may be NULL until their stage. */
+typedef struct {
+    const process_info *info;
+    const char *comm;
+    const char *user;
+    const char *command;
+    bool status_unknown; /* /proc/<pid>/status was unreadable: its fields are unknown */
+} filter_subject;
+
+// Compiles expr; on failure returns NULL and describes the problem in err.
+process_filter *filter_compile(const char *expr, char *err, size_t errlen);
+void filter_free(process_filter *filter);
+
+// PROC_FIELD_* bits the program needs read to reach a verdict.
+unsigned int filter_fields(const process_filter *filter);
+
+// Three-valued evaluation with only the given FILTER_STAGE_* fields known.
+filter_result filter_eval(const process_filter *filter, const filter_subject *subject,
+                          unsigned int stages);
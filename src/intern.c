@@ -0,0 +1,311 @@
+#define _GNU_SOURCE
+
+#include "intern.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+#define INTERN_MIN_BYTES 16384
+
+void intern_pool_init(intern_pool *pool) {
+    if (!pool)
+        return;
+    memset(pool, 0, sizeof(*pool));
+}
+
+void intern_pool_free(intern_pool *pool) {
+    if (!pool)
+        return;
+    free(pool->bytes);
+    free(pool->strings);
+    free(pool->table);
+    intern_pool_init(pool);
+}
+
+static uint32_t hash_string(const char *str, size_t len) {
+    uint32_t h = 2166136261u; /* FNV-1a */
+    for (size_t i = 0; i < len; ++i) {
+        h ^= (unsigned char)str[i];
+        h *= 16777619u;
+    }
+    return h;
+}
+
+static size_t table_home(uint32_t hash, size_t capacity) {
+    return (size_t)((hash * 2654435769u) >> 8) & (capacity - 1);
+}
+
+static int table_grow(intern_pool *pool) {
+    size_t new_cap = pool->table_capacity ? pool->table_capacity * 2 : 256;
+    intern_id *table = calloc(new_cap, sizeof(intern_id));
+    if (!table)
+        return -1;
+    for (size_t i = 0; i < pool->table_capacity; ++i) {
+        intern_id id = pool->table[i];
+        if (id == 0)
+            continue;
+        size_t j = table_home(pool->strings[id].hash, new_cap);
+        while (table[j] != 0)
+            j = (j + 1) & (new_cap - 1);
+        table[j] = id;
+    }
+    free(pool->table);
+    pool->table = table;
+    pool->table_capacity = new_cap;
+    return 0;
+}
+
+/* Backward-shift deletion keeps every probe chain unbroken. */
+static void table_remove(intern_pool *pool, intern_id id) {
+    size_t mask = pool->table_capacity - 1;
+    size_t i = table_home(pool->strings[id].hash, pool->table_capacity);
+    while (pool->table[i] != id)
+        i = (i + 1) & mask;
+    size_t j = i;
+    for (;;) {
+        j = (j + 1) & mask;
+        intern_id moved = pool->table[j];
+        if (moved == 0)
+            break;
+        size_t home = table_home(pool->strings[moved].hash, pool->table_capacity);
+        /* moved may fill the hole only if the hole lies on its probe path */
+        if (((j - home) & mask) >= ((j - i) & mask)) {
+            pool->table[i] = moved;
+            i = j;
+        }
+    }
+    pool->table[i] = 0;
+}
+
+/* Rewrites bytes with only the live strings, in slot order. */
+static void compact_bytes(intern_pool *pool) {
+    char *bytes = malloc(pool->bytes_capacity);
+    if (!bytes)
+        return;
+    size_t len = 0;
+    for (uint32_t id = 1; id < pool->slot_count; ++id) {
+        intern_string *s = &pool->strings[id];
+        if (s->refs == 0)
+            continue;
+        memcpy(bytes + len, pool->bytes + s->offset, s->len + 1);
+        s->offset = len;
+        len += s->len + 1;
+    }
+    free(pool->bytes);
+    pool->bytes = bytes;
+    pool->bytes_len = len;
+    pool->bytes_dead = 0;
+}
+
+/* Makes room for need more bytes, compacting first when at least half of
+ * the buffer belongs to released strings. */
+static int reserve_bytes(intern_pool *pool, size_t need) {
+    if (pool->bytes_len + need <= pool->bytes_capacity)
+        return 0;
+    if (pool->bytes_dead * 2 >= pool->bytes_len) {
+        compact_bytes(pool);
+        if (pool->bytes_len + need <= pool->bytes_capacity)
+            return 0;
+    }
+    size_t new_cap = pool->bytes_capacity ? pool->bytes_capacity * 2 : INTERN_MIN_BYTES;
+    while (new_cap < pool->bytes_len + need)
+        new_cap *= 2;
+    char *bytes = realloc(pool->bytes, new_cap);
+    if (!bytes)
+        return -1;
+    pool->bytes = bytes;
+    pool->bytes_capacity = new_cap;
+    return 0;
+}
+
+static int alloc_slot(intern_pool *pool, intern_id *out) {
+    if (pool->free_slot != 0) {
+        *out = pool->free_slot;
+        pool->free_slot = pool->strings[*out].next_free;
+        return 0;
+    }
+    if (pool->slot_count == pool->slot_capacity) {
+        uint32_t new_cap = pool->slot_capacity ? pool->slot_capacity * 2 : 256;
+        intern_string *strings = realloc(pool->strings, new_cap * sizeof(intern_string));
+        if (!strings)
+            return -1;
+        pool->strings = strings;
+        pool->slot_capacity = new_cap;
+    }
+    if (pool->slot_count == 0)
+        pool->slot_count = 1; /* slot 0 is the empty string */
+    *out = pool->slot_count++;
+    return 0;
+}
+
+int intern_acquire(intern_pool *pool, const char *str, intern_id *out) {
+    if (!pool || !str || !out)
+        return -1;
+    size_t len = strlen(str);
+    if (len == 0) {
+        *out = 0;
+        return 0;
+    }
+    if (len >= UINT32_MAX)
+        return -1;
+    uint32_t hash = hash_string(str, len);
+
+    if (pool->table_capacity > 0) {
+        size_t mask = pool->table_capacity - 1;
+        for (size_t i = table_home(hash, pool->table_capacity); pool->table[i] != 0;
+             i = (i + 1) & mask) {
+            intern_string *s = &pool->strings[pool->table[i]];
+            if (s->hash == hash && s->len == len && memcmp(pool->bytes + s->offset, str, len) == 0) {
+                s->refs++;
+                *out = pool->table[i];
+                return 0;
+            }
+        }
+    }
+
+    if ((pool->live + 1) * 2 > pool->table_capacity && table_grow(pool) != 0)
+        return -1;
+    if (reserve_bytes(pool, len + 1) != 0)
+        return -1;
+    intern_id id;
+    if (alloc_slot(pool, &id) != 0)
+        return -1;
+
+    intern_string *s = &pool->strings[id];
+    s->offset = pool->bytes_len;
+    s->len = (uint32_t)len;
+    s->hash = hash;
+    s->refs = 1;
+    s->rank = 0;
+    s->next_free = 0;
+    memcpy(pool->bytes + pool->bytes_len, str, len + 1);
+    pool->bytes_len += len + 1;
+
+    size_t mask = pool->table_capacity - 1;
+    size_t i = table_home(hash, pool->table_capacity);
+    while (pool->table[i] != 0)
+        i = (i + 1) & mask;
+    pool->table[i] = id;
+    pool->live++;
+    pool->ranks_valid = false;
+    *out = id;
+    return 0;
+}
+
+void intern_retain(intern_pool *pool, intern_id id) {
+    if (pool && id != 0)
+        pool->strings[id].refs++;
+}
+
+void intern_release(intern_pool *pool, intern_id id) {
+    if (!pool || id == 0)
+        return;
+    intern_string *s = &pool->strings[id];
+    if (--s->refs > 0)
+        return;
+    table_remove(pool, id);
+    pool->bytes_dead += s->len + 1;
+    s->next_free = pool->free_slot;
+    pool->free_slot = id;
+    pool->live--;
+}
+
+const char *intern_str(const intern_pool *pool, intern_id id) {
+    if (!pool || id == 0)
+        return "";
+    return pool->bytes + pool->strings[id].offset;
+}
+
+/* Grows *buf to hold at least size bytes, without keeping its contents. */
+static int reserve_copy(void **buf, size_t *capacity, size_t size) {
+    if (*capacity >= size)
+        return 0;
+    void *grown = realloc(*buf, size);
+    if (!grown)
+        return -1;
+    *buf = grown;
+    *capacity = size;
+    return 0;
+}
+
+int intern_pool_copy(intern_pool *dst, const intern_pool *src) {
+    if (!dst || !src)
+        return -1;
+    size_t bytes_cap = dst->bytes_capacity;
+    size_t strings_cap = dst->slot_capacity * sizeof(intern_string);
+    size_t table_cap = dst->table_capacity * sizeof(intern_id);
+    if (reserve_copy((void **)&dst->bytes, &bytes_cap, src->bytes_capacity) != 0 ||
+        reserve_copy((void **)&dst->strings, &strings_cap,
+                     src->slot_capacity * sizeof(intern_string)) != 0)
+        return -1;
+    dst->bytes_capacity = bytes_cap;
+    dst->slot_capacity = (uint32_t)(strings_cap / sizeof(intern_string));
+    /* the table keeps its own power-of-two size, so it is replaced outright */
+    if (table_cap != src->table_capacity * sizeof(intern_id)) {
+        intern_id *table = malloc(src->table_capacity * sizeof(intern_id));
+        if (src->table_capacity > 0 && !table)
+            return -1;
+        free(dst->table);
+        dst->table = table;
+    }
+    if (src->bytes_len > 0)
+        memcpy(dst->bytes, src->bytes, src->bytes_len);
+    if (src->slot_count > 0)
+        memcpy(dst->strings, src->strings, src->slot_count * sizeof(intern_string));
+    if (src->table_capacity > 0)
+        memcpy(dst->table, src->table, src->table_capacity * sizeof(intern_id));
+    dst->bytes_len = src->bytes_len;
+    dst->bytes_dead = src->bytes_dead;
+    dst->slot_count = src->slot_count;
+    dst->free_slot = src->free_slot;
+    dst->table_capacity = src->table_capacity;
+    dst->live = src->live;
+    dst->ranks_valid = src->ranks_valid;
+    return 0;
+}
+
+static int compare_ids(const void *lhs, const void *rhs, void *ctx) {
+    const intern_pool *pool = ctx;
+    return strcasecmp(intern_str(pool, *(const intern_id *)lhs),
+                      intern_str(pool, *(const intern_id *)rhs));
+}
+
+/* Sorts the live strings once and numbers them, so that comparing two
+ * handles is an integer compare until a new string shows up. Strings that
+ * differ only in case share a rank, matching strcasecmp. */
+int intern_update_ranks(intern_pool *pool) {
+    if (!pool)
+        return -1;
+    if (pool->ranks_valid)
+        return 0;
+    intern_id *ids = malloc((pool->live + 1) * sizeof(intern_id));
+    if (!ids)
+        return -1;
+    size_t n = 0;
+    for (uint32_t id = 1; id < pool->slot_count; ++id) {
+        if (pool->strings[id].refs > 0)
+            ids[n++] = id;
+    }
+    qsort_r(ids, n, sizeof(intern_id), compare_ids, pool);
+    uint32_t rank = 1; /* 0 is the empty string */
+    for (size_t i = 0; i < n; ++i) {
+        if (i > 0 && compare_ids(&ids[i - 1], &ids[i], pool) != 0)
+            rank++;
+        pool->strings[ids[i]].rank = rank;
+    }
+    free(ids);
+    pool->ranks_valid = true;
+    return 0;
+}
+
+int intern_compare(const intern_pool *pool, intern_id a, intern_id b) {
+    if (a == b)
+        return 0;
+    if (pool->ranks_valid) {
+        uint32_t ra = a ? pool->strings[a].rank : 0;
+        uint32_t rb = b ? pool->strings[b].rank : 0;
+        return (ra > rb) - (ra < rb);
+    }
+    return strcasecmp(intern_str(pool, a), intern_str(pool, b));
+}
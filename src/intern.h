@@ -0,0 +1,59 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Handle to an interned string. Equal strings share one handle, so they
+ * compare with ==. Handle 0 is the empty string and needs no reference. */
+typedef uint32_t intern_id;
+
+typedef struct {
+    size_t offset;   /* into intern_pool.bytes */
+    uint32_t len;    /* without the NUL */
+    uint32_t hash;
+    uint32_t refs;   /* 0 marks a free slot */
+    uint32_t rank;   /* case-insensitive sort position, see intern_update_ranks() */
+    intern_id next_free;
+} intern_string;
+
+/* Reference-counted string pool. Strings live back to back in bytes;
+ * handles index the slot table and stay valid while the bytes behind them
+ * are compacted away from released strings. */
+typedef struct {
+    char *bytes;
+    size_t bytes_len;
+    size_t bytes_capacity;
+    size_t bytes_dead;       /* bytes held by released strings */
+
+    intern_string *strings;  /* slot table, indexed by intern_id */
+    uint32_t slot_count;
+    uint32_t slot_capacity;
+    intern_id free_slot;     /* 0 when no slot is free */
+
+    intern_id *table;        /* hash -> handle, open addressing, 0 = empty */
+    size_t table_capacity;   /* zero or a power of two */
+    size_t live;
+
+    bool ranks_valid;
+} intern_pool;
+
+void intern_pool_init(intern_pool *pool);
+void intern_pool_free(intern_pool *pool);
+
+// Returns a referenced handle for str in *out; 0 on success, -1 on allocation failure.
+int intern_acquire(intern_pool *pool, const char *str, intern_id *out);
+void intern_retain(intern_pool *pool, intern_id id);
+void intern_release(intern_pool *pool, intern_id id);
+
+const char *intern_str(const intern_pool *pool, intern_id id);
+
+// Make dst an exact copy of src, reusing dst's buffers; handles of src
+// resolve to the same strings in dst. Returns -1 on allocation failure.
+int intern_pool_copy(intern_pool *dst, const intern_pool *src);
+
+// Assign case-insensitive ranks once strings were added; returns -1 on allocation failure.
+int intern_update_ranks(intern_pool *pool);
+
+// strcasecmp order of two handles, by rank when the ranks are current.
+int intern_compare(const intern_pool *pool, intern_id a, intern_id b);
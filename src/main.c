@@ -3,6 +3,9 @@ cuPID is a simple process manager for Linux
 written by @frankischilling
 11/27/2025 thanksgiving :) turkey day!
 */
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -20,6 +23,7 @@ written by @frankischilling
 #include "process.h"
 #include "cpu.h"
 #include "memory.h"
+#include "sampler.h"
 
 static double timespec_elapsed(struct timespec prev, struct timespec current) {
     double sec = (double)(current.tv_sec - prev.tv_sec);
@@ -27,6 +31,78 @@ static double timespec_elapsed(struct timespec prev, struct timespec current) {
     return sec + nsec;
 }
 
+// xterm focus reports (CSI I / CSI O), mapped to keys of our own
+#define KEY_FOCUS_IN (KEY_MAX + 1)
+#define KEY_FOCUS_OUT (KEY_MAX + 2)
+
+static void set_focus_reports(bool on) {
+    static const char enable[] = "\033[?1004h";
+    static const char disable[] = "\033[?1004l";
+    // write(), since this also runs in the SIGTSTP handler
+    ssize_t written = on ? write(STDOUT_FILENO, enable, sizeof(enable) - 1)
+                         : write(STDOUT_FILENO, disable, sizeof(disable) - 1);
+    (void)written;
+}
+
+static struct sigaction curses_tstp; // ncurses' own handler, chained to
+
+/* Ctrl-Z: the shell would print the reports while it has the terminal,
+ * so they are off until ncurses returns from fg. */
+static void focus_tstp(int sig, siginfo_t *info, void *context) {
+    set_focus_reports(false);
+    if (curses_tstp.sa_flags & SA_SIGINFO) {
+        curses_tstp.sa_sigaction(sig, info, context);
+    } else if (curses_tstp.sa_handler == SIG_DFL) {
+        /* stop the default way: SIGTSTP is blocked while this handler
+         * runs, so it has to be unblocked for raise() to stop us */
+        struct sigaction dfl = {0}, ours;
+        dfl.sa_handler = SIG_DFL;
+        sigemptyset(&dfl.sa_mask);
+        sigaction(SIGTSTP, &dfl, &ours);
+        sigset_t tstp, mask;
+        sigemptyset(&tstp);
+        sigaddset(&tstp, SIGTSTP);
+        sigprocmask(SIG_UNBLOCK, &tstp, &mask);
+        raise(SIGTSTP);
+        /* SIGCONT resumes here */
+        sigprocmask(SIG_SETMASK, &mask, NULL);
+        sigaction(SIGTSTP, &ours, NULL);
+    } else if (curses_tstp.sa_handler != SIG_IGN) {
+        curses_tstp.sa_handler(sig);
+    }
+    set_focus_reports(true);
+}
+
+/* State of the '/' filter prompt in the footer. */
+typedef struct {
+    bool editing;
+    char text[128];    /* being typed */
+    size_t len;
+    char active[128];  /* handed to the sampler */
+    char error[128];   /* last compile error, shown until the next edit */
+} filter_prompt;
+
+static bool is_smaps_column(const char *column) {
+    return strcasecmp(column, "pss") == 0 || strcasecmp(column, "uss") == 0 ||
+           strcasecmp(column, "swap_pss") == 0 || strcasecmp(column, "smaps_age") == 0;
+}
+
+static bool is_io_column(const char *column) {
+    return strcasecmp(column, "io_read") == 0 || strcasecmp(column, "io_write") == 0 ||
+           strcasecmp(column, "io_cancelled") == 0;
+}
+
+// Bytes per second, in the configured memory units
+static void format_rate(double bytes_per_sec, const cupid_config *config, char *buffer, size_t len) {
+    if (bytes_per_sec < 0.0) {
+        snprintf(buffer, len, "-"); // /proc/<pid>/io is not readable
+        return;
+    }
+    char size[32];
+    format_size_kb_units((long)(bytes_per_sec / 1024.0), config, size, sizeof(size));
+    snprintf(buffer, len, "%s/s", size);
+}
+
 static int get_column_width(const char *column, int remaining_space, int remaining_columns) {
     if (remaining_columns <= 1)
         return remaining_space;
@@ -36,7 +112,7 @@ static int get_column_width(const char *column, int remaining_space, int remaini
         return 12;
     if (strcasecmp(column, "state") == 0)
         return 4;
-    if (strcasecmp(column, "cpu") == 0)
+    if (strcasecmp(column, "cpu") == 0 || strcasecmp(column, "runq") == 0)
         return 8;
     if (strcasecmp(column, "mem") == 0)
         return 8;
@@ -44,36 +120,99 @@ static int get_column_width(const char *column, int remaining_space, int remaini
         return 10;
     if (strcasecmp(column, "threads") == 0)
         return 8;
+    if (strcasecmp(column, "time") == 0)
+        return 11;
+    if (strcasecmp(column, "swap") == 0)
+        return 10;
+    if (strcasecmp(column, "nspid") == 0)
+        return 7;
+    if (strcasecmp(column, "vcsw") == 0 || strcasecmp(column, "nvcsw") == 0)
+        return 10;
+    if (strcasecmp(column, "cpu_tree") == 0)
+        return 10;
+    if (strcasecmp(column, "rss_tree") == 0)
+        return 10;
+    if (strcasecmp(column, "threads_tree") == 0)
+        return 13;
+    if (is_smaps_column(column))
+        return 10;
+    if (is_io_column(column))
+        return 11;
     return 12;
 }
+
 static void format_column_value(const cupid_config *config,
-                                const process_info *info,
+                                const process_list *list,
+                                size_t row,
                                 const char *column,
                                 char *buffer,
                                 size_t len) {
-    if (!buffer || len == 0 || !info || !column)
+    if (!buffer || len == 0 || !list || row >= list->rows || !column)
         return;
 
+    const process_detail *info = &list->detail[row];
     if (strcasecmp(column, "pid") == 0)
-        snprintf(buffer, len, "%5d", info->pid);
+        snprintf(buffer, len, "%5d", list->pid[row]);
     else if (strcasecmp(column, "ppid") == 0)
-        snprintf(buffer, len, "%5d", info->ppid);
+        snprintf(buffer, len, "%5d", list->ppid[row]);
     else if (strcasecmp(column, "user") == 0)
-        snprintf(buffer, len, "%s", info->user);
+        snprintf(buffer, len, "%s", process_list_user(list, row));
     else if (strcasecmp(column, "state") == 0)
         snprintf(buffer, len, "%c", info->state);
     else if (strcasecmp(column, "cpu") == 0)
-        snprintf(buffer, len, "%5.1f%%", info->cpu_percent);
+        snprintf(buffer, len, "%5.1f%%", list->cpu_percent[row]);
     else if (strcasecmp(column, "mem") == 0)
-        snprintf(buffer, len, "%5.1f%%", info->mem_percent);
+        snprintf(buffer, len, "%5.1f%%", list->mem_percent[row]);
     else if (strcasecmp(column, "threads") == 0)
         snprintf(buffer, len, "%4d", info->threads);
     else if (strcasecmp(column, "rss") == 0)
-        format_size_kb_units(info->rss_kb, config, buffer, len);
+        format_size_kb_units(list->rss_kb[row], config, buffer, len);
+    else if (strcasecmp(column, "swap") == 0)
+        format_size_kb_units(info->swap_kb, config, buffer, len);
+    else if (strcasecmp(column, "nspid") == 0)
+        snprintf(buffer, len, "%5d", info->nspid);
+    else if (strcasecmp(column, "vcsw") == 0)
+        snprintf(buffer, len, "%llu", info->ctxt_voluntary);
+    else if (strcasecmp(column, "nvcsw") == 0)
+        snprintf(buffer, len, "%llu", info->ctxt_involuntary);
+    else if (strcasecmp(column, "cpu_tree") == 0)
+        snprintf(buffer, len, "%5.1f%%", info->cpu_tree);
+    else if (strcasecmp(column, "rss_tree") == 0)
+        format_size_kb_units(info->rss_tree, config, buffer, len);
+    else if (strcasecmp(column, "threads_tree") == 0)
+        snprintf(buffer, len, "%4d", info->threads_tree);
     else if (strcasecmp(column, "vms") == 0)
         format_size_kb_units(info->vms_kb, config, buffer, len);
+    else if (info->smaps_age < 0.0 && is_smaps_column(column))
+        snprintf(buffer, len, "-"); // not sampled yet, or smaps_rollup is not readable
+    else if (strcasecmp(column, "pss") == 0)
+        format_size_kb_units(info->pss_kb, config, buffer, len);
+    else if (strcasecmp(column, "uss") == 0)
+        format_size_kb_units(info->uss_kb, config, buffer, len);
+    else if (strcasecmp(column, "swap_pss") == 0)
+        format_size_kb_units(info->swap_pss_kb, config, buffer, len);
+    else if (strcasecmp(column, "smaps_age") == 0)
+        snprintf(buffer, len, "%.1fs", info->smaps_age);
+    else if (strcasecmp(column, "io_read") == 0)
+        format_rate(info->io_read_rate, config, buffer, len);
+    else if (strcasecmp(column, "io_write") == 0)
+        format_rate(info->io_write_rate, config, buffer, len);
+    else if (strcasecmp(column, "io_cancelled") == 0)
+        format_rate(info->io_cancelled_rate, config, buffer, len);
+    else if (strcasecmp(column, "runq") == 0) {
+        if (info->runq_percent < 0.0)
+            snprintf(buffer, len, "-"); // schedstat is not available
+        else
+            snprintf(buffer, len, "%5.1f%%", info->runq_percent);
+    }
+    else if (strcasecmp(column, "time") == 0) {
+        // minutes:seconds.hundredths, like top's TIME+
+        unsigned long long hundredths = (unsigned long long)(info->cpu_time * 100.0);
+        snprintf(buffer, len, "%llu:%02llu.%02llu", hundredths / 6000,
+                 (hundredths / 100) % 60, hundredths % 100);
+    }
     else if (strcasecmp(column, "command") == 0)
-        snprintf(buffer, len, "%s", info->command);
+        snprintf(buffer, len, "%s", process_list_command(list, row));
     else
         snprintf(buffer, len, "-");
 }
@@ -88,30 +227,43 @@ static void uppercase_copy(const char *src, char *dest, size_t len) {
     dest[i] = '\0';
 }
 
-static void dfs_children(const process_list *list,
-                         size_t idx,
-                         int depth,
+/* Appends the subtree under root in pre-order. Walks the child/sibling
+ * links and climbs back through parent, so deep chains need no stack.
+ * visited guards against a ppid cycle from a torn snapshot. */
+static void walk_subtree(const process_list *list,
+                         size_t root,
                          size_t *order,
                          int *depths,
                          size_t *out_count,
                          bool *visited) {
-    if (!list || !order || !depths || !out_count || !visited)
-        return;
-    if (visited[idx])
-        return;
-    visited[idx] = true;
-    order[*out_count] = idx;
-    depths[*out_count] = depth;
-    (*out_count)++;
-
-    pid_t parent_pid = list->items[idx].pid;
-    for (size_t i = 0; i < list->count; ++i) {
-        if (!visited[i] && list->items[i].ppid == parent_pid) {
-            dfs_children(list, i, depth + 1, order, depths, out_count, visited);
+    size_t row = root;
+    int depth = 0;
+    for (;;) {
+        visited[row] = true;
+        order[*out_count] = row;
+        depths[*out_count] = depth;
+        (*out_count)++;
+
+        size_t child = list->first_child[row];
+        if (child != PROCESS_ROW_NONE && !visited[child]) {
+            row = child;
+            depth++;
+            continue;
+        }
+        while (row != root) {
+            size_t next = list->next_sibling[row];
+            if (next != PROCESS_ROW_NONE && !visited[next])
+                break;
+            row = list->parent[row];
+            depth--;
         }
+        if (row == root)
+            return;
+        row = list->next_sibling[row];
     }
 }
 
+/* Fills order with the rows to draw, top to bottom. */
 static void build_row_order(const cupid_config *config,
                             const process_list *list,
                             size_t *order,
@@ -125,71 +277,49 @@ static void build_row_order(const cupid_config *config,
     if (n == 0)
         return;
 
-    if (config->tree_view_default == TREE_VIEW_FLAT) {
+    bool *visited = NULL;
+    if (config->tree_view_default != TREE_VIEW_FLAT)
+        visited = calloc(list->rows, sizeof(bool));
+    if (!visited) {
         for (size_t i = 0; i < n; ++i) {
-            order[i] = i;
+            order[i] = list->order[i];
             depths[i] = 0;
         }
         *out_count = n;
         return;
     }
 
-    bool *is_root = calloc(n, sizeof(bool));
-    bool *visited = calloc(n, sizeof(bool));
-    if (!is_root || !visited) {
-        free(is_root);
-        free(visited);
-        for (size_t i = 0; i < n; ++i) {
-            order[i] = i;
-            depths[i] = 0;
-        }
-        *out_count = n;
-        return;
-    }
-
-    for (size_t i = 0; i < n; ++i) {
-        is_root[i] = true;
-    }
-    for (size_t i = 0; i < n; ++i) {
-        pid_t ppid = list->items[i].ppid;
-        for (size_t j = 0; j < n; ++j) {
-            if (list->items[j].pid == ppid) {
-                is_root[i] = false;
-                break;
-            }
-        }
-    }
-
     if (config->tree_view_default == TREE_VIEW_EXPANDED) {
         for (size_t i = 0; i < n; ++i) {
-            if (is_root[i]) {
-                dfs_children(list, i, 0, order, depths, out_count, visited);
-            }
+            size_t row = list->order[i];
+            if (list->parent[row] == PROCESS_ROW_NONE)
+                walk_subtree(list, row, order, depths, out_count, visited);
         }
         for (size_t i = 0; i < n; ++i) {
-            if (!visited[i]) {
-                dfs_children(list, i, 0, order, depths, out_count, visited);
-            }
+            size_t row = list->order[i];
+            if (!visited[row])
+                walk_subtree(list, row, order, depths, out_count, visited);
         }
     } else { // TREE_VIEW_COLLAPSED
         for (size_t i = 0; i < n; ++i) {
-            if (is_root[i]) {
-                order[*out_count] = i;
+            size_t row = list->order[i];
+            if (list->parent[row] == PROCESS_ROW_NONE) {
+                order[*out_count] = row;
                 depths[*out_count] = 0;
                 (*out_count)++;
-                visited[i] = true;
+                visited[row] = true;
             }
         }
         for (size_t i = 0; i < n; ++i) {
-            if (!visited[i]) {
-                order[*out_count] = i;
+            size_t row = list->order[i];
+            if (!visited[row]) {
+                order[*out_count] = row;
                 depths[*out_count] = 0;
                 (*out_count)++;
             }
         }
     }
 
-    free(is_root);
     free(visited);
 }
 
@@ -260,15 +390,8 @@ static void render_process_table(const cupid_config *config,
     }
 
     size_t out_count = 0;
-    if (order && depths) {
+    if (order && depths)
         build_row_order(config, list, order, depths, &out_count);
-    } else {
-        for (size_t i = 0; i < n; ++i) {
-            order[i] = i;
-            depths[i] = 0;
-        }
-        out_count = n;
-    }
 
     int threads_index = -1;
     for (int i = 0; i < token_count; ++i) {
@@ -367,9 +490,8 @@ static void render_process_table(const cupid_config *config,
 
     for (size_t row = 0; row < max_rows; ++row) {
         int logical_row = scroll_offset + (int)row;
-        size_t idx = order[logical_row];
+        size_t item = order[logical_row];
         int depth = depths[logical_row];
-        const process_info *info = &list->items[idx];
         int y = first_row + (int)row;
         x = 2;
 
@@ -419,7 +541,7 @@ static void render_process_table(const cupid_config *config,
                 break;
 
             char value[256];
-            format_column_value(config, info, tokens[col], value, sizeof(value));
+            format_column_value(config, list, item, tokens[col], value, sizeof(value));
 
             if (config->tree_view_default != TREE_VIEW_FLAT &&
                 is_command_col &&
@@ -518,18 +640,33 @@ static void render_ui(const cupid_config *config,
                       int scroll_offset,
                       int *visible_rows,
                       int *total_rows,
-                      view_mode_t view_mode) {
+                      view_mode_t view_mode,
+                      const filter_prompt *prompt,
+                      double tick_lateness,
+                      unsigned long ticks_missed,
+                      int refresh_ms) {
     int rows, cols;
     getmaxyx(stdscr, rows, cols);
     (void)cols;
     erase();
     box(stdscr, 0, 0);
 
-    mvprintw(1, 2, "cuPID  refresh=%d ms  sort=%s%s  processes=%zu",
-             config->refresh_rate_ms,
+    // How late the last refresh started, and how many were skipped because one overran
+    char timing[48];
+    if (ticks_missed > 0)
+        snprintf(timing, sizeof(timing), " (late %.1f ms, %lu missed)", tick_lateness * 1000.0, ticks_missed);
+    else
+        snprintf(timing, sizeof(timing), " (late %.1f ms)", tick_lateness * 1000.0);
+
+    mvprintw(1, 2, "cuPID  refresh=%d ms%s%s  sort=%s%s  processes=%zu%s%s",
+             refresh_ms,
+             config->refresh_adaptive ? " auto" : "",
+             timing,
              config->default_sort,
              config->sort_reverse ? " (desc)" : "",
-             list->count);
+             list->count,
+             prompt->active[0] ? "  filter=" : "",
+             prompt->active);
 
     int panel_start_row = 2;
     
@@ -629,10 +766,14 @@ static void render_ui(const cupid_config *config,
         }
     }
 
-    if (view_mode == VIEW_PROCESSES) {
-        mvprintw(rows - 2, 2, "Press 'q' to exit, 'v' to switch view. Use Arrow up / down to move, PgUp/PgDn to scroll.");
+    if (prompt->editing) {
+        mvprintw(rows - 2, 2, "Filter: %s_  (Enter to apply, Esc to cancel)", prompt->text);
+    } else if (prompt->error[0]) {
+        mvprintw(rows - 2, 2, "Filter error: %s", prompt->error);
+    } else if (view_mode == VIEW_PROCESSES) {
+        mvprintw(rows - 2, 2, "Press 'q' to exit, 'v' to switch view, '/' to filter. Use Arrow up / down to move, PgUp/PgDn to scroll.");
     } else {
-        mvprintw(rows - 2, 2, "Press 'q' to exit, 'v' to switch view. Use Arrow up / down to move, PgUp/PgDn to scroll.");
+        mvprintw(rows - 2, 2, "Press 'q' to exit, 'v' to switch view, '/' to filter. Use Arrow up / down to move, PgUp/PgDn to scroll.");
     }
 
     // Adjust table start based on panels
@@ -678,68 +819,104 @@ int main(int argc, char *argv[]) {
     cbreak();
     noecho();
     keypad(stdscr, TRUE);
-    timeout(100); // short poll for input; data refresh is timed separately
+    set_escdelay(25); // Esc cancels the filter prompt without a long wait
+    nodelay(stdscr, TRUE); // the main loop waits in poll(), getch() only collects
     curs_set(0);
     
     // Enable mouse support for proper wheel handling
     mousemask(ALL_MOUSE_EVENTS | REPORT_MOUSE_POSITION, NULL);
 
-    process_cache cache;
-    process_cache_init(&cache);
-    process_list plist;
-    process_list_init(&plist);
+    // The adaptive rate slows sampling while the terminal is out of focus
+    if (config.refresh_adaptive) {
+        define_key("\033[I", KEY_FOCUS_IN);
+        define_key("\033[O", KEY_FOCUS_OUT);
+        struct sigaction tstp = {0};
+        tstp.sa_sigaction = focus_tstp;
+        tstp.sa_flags = SA_SIGINFO;
+        sigemptyset(&tstp.sa_mask);
+        sigaction(SIGTSTP, &tstp, &curses_tstp);
+        set_focus_reports(true);
+    }
 
-    struct timespec last_data_refresh;
-    clock_gettime(CLOCK_MONOTONIC, &last_data_refresh);
-    const double refresh_interval = (config.refresh_rate_ms > 50
-                                     ? (double)config.refresh_rate_ms
-                                     : 50.0) / 1000.0;
+    // Sampling runs on its own thread; this loop only draws its snapshots
+    filter_prompt prompt = {0};
+    sampler sampler;
+    if (sampler_start(&sampler, &config, prompt.error, sizeof(prompt.error)) != 0) {
+        if (config.refresh_adaptive)
+            set_focus_reports(false);
+        endwin();
+        fprintf(stderr, "Failed to start the sampler thread.\n");
+        return 1;
+    }
+    if (!prompt.error[0])
+        snprintf(prompt.active, sizeof(prompt.active), "%s", config.default_filter);
 
     bool running = true;
     int selected_row = 0;
     int visible_rows = 0;
     int total_rows = 0;
     int scroll_offset = 0;
-    bool have_data = false;
-    double last_cpu_usage = -1.0;
-    mem_info_t last_mem_info = {0};
-    bool have_mem_info = false;
-    cpu_info_t cpu_info;
-    cpu_info_init(&cpu_info);
-    bool have_cpu_info = false;
     view_mode_t view_mode = VIEW_CPU_MEMORY; // Start in CPU/Memory view
     struct timespec last_key_input = {0, 0};
     const double key_debounce_interval = 0.05; // 50ms debounce for key inputs
+    // Sleep until a key or a new snapshot arrives; nothing wakes us in between
+    struct pollfd events[2] = {
+        {.fd = STDIN_FILENO, .events = POLLIN},
+        {.fd = sampler.notify_fd, .events = POLLIN},
+    };
+    bool keys_pending = true; // ncurses may have buffered keys that poll() cannot see
     while (running) {
         bool selection_changed = false;
-        bool data_changed = false;
 
+        if (!keys_pending && poll(events, 2, -1) < 0 && errno != EINTR)
+            break;
+        int ch = getch(); // EINTR from SIGWINCH turns into KEY_RESIZE here
+        keys_pending = ch != ERR;
         struct timespec now;
         clock_gettime(CLOCK_MONOTONIC, &now);
-        double elapsed = timespec_elapsed(last_data_refresh, now);
 
-        if (!have_data || elapsed >= refresh_interval) {
-            if (process_list_refresh(&plist, &cache, have_data ? elapsed : refresh_interval, &config) != 0) {
-                mvprintw(1, 2, "Failed to read processes.");
-                refresh();
-            } else {
-                have_data = true;
-                last_data_refresh = now;
-                data_changed = true;
-                if (config.show_cpu_panel) {
-                    last_cpu_usage = read_cpu_usage_percent();
-                    if (read_full_cpu_info(&cpu_info) == 0)
-                        have_cpu_info = true;
-                }
-                if (config.show_memory_panel) {
-                    if (read_full_mem_info(&last_mem_info))
-                        have_mem_info = true;
+        // Take the newest snapshot; it stays ours until the next call
+        bool data_changed = false;
+        sampler_snapshot *snap = sampler_acquire(&sampler, &data_changed);
+
+        // Focus changes pause and resume sampling; keys keep the rate up
+        if (ch == KEY_FOCUS_IN || ch == KEY_FOCUS_OUT)
+            sampler_set_hidden(&sampler, ch == KEY_FOCUS_OUT);
+        else if (ch != ERR && ch != KEY_RESIZE)
+            sampler_note_input(&sampler);
+
+        if (prompt.editing) {
+            // The prompt owns the keyboard until Enter or Esc
+            if (ch == '\n' || ch == '\r' || ch == KEY_ENTER) {
+                prompt.editing = false;
+                if (sampler_set_filter(&sampler, prompt.text, prompt.error, sizeof(prompt.error)) == 0) {
+                    snprintf(prompt.active, sizeof(prompt.active), "%s", prompt.text);
+                    selected_row = 0;
+                    scroll_offset = 0;
                 }
+                selection_changed = true;
+            } else if (ch == 27) { // Esc
+                prompt.editing = false;
+                selection_changed = true;
+            } else if (ch == KEY_BACKSPACE || ch == 127 || ch == 8) {
+                if (prompt.len > 0)
+                    prompt.text[--prompt.len] = '\0';
+                selection_changed = true;
+            } else if (ch >= 32 && ch < 127 && prompt.len + 1 < sizeof(prompt.text)) {
+                prompt.text[prompt.len++] = (char)ch;
+                prompt.text[prompt.len] = '\0';
+                selection_changed = true;
             }
-        }
-
-        int ch = getch();
-        if (ch == 'q' || ch == 'Q') {
+        } else if (ch == '/') {
+            // Start from the active filter so it can be refined
+            prompt.editing = true;
+            prompt.error[0] = '\0';
+            snprintf(prompt.text, sizeof(prompt.text), "%s", prompt.active);
+            prompt.len = strlen(prompt.text);
+            selection_changed = true;
+        } else if (ch == KEY_RESIZE) {
+            selection_changed = true; // redraw now rather than at the next snapshot
+        } else if (ch == 'q' || ch == 'Q') {
             running = false;
         } else if (ch == 'v' || ch == 'V') {
             // Toggle view mode
@@ -796,9 +973,10 @@ int main(int argc, char *argv[]) {
             selection_changed = true;
         }
 
-        if (have_data && (data_changed || selection_changed)) {
-            if (selected_row >= (int)plist.count)
-                selected_row = (int)plist.count - 1;
+        if (snap && (data_changed || selection_changed)) {
+            const process_list *plist = &snap->list;
+            if (selected_row >= (int)plist->count)
+                selected_row = (int)plist->count - 1;
             if (selected_row < 0)
                 selected_row = 0;
 
@@ -808,15 +986,24 @@ int main(int argc, char *argv[]) {
                 scroll_offset = selected_row - visible_rows + 1;
             if (scroll_offset < 0)
                 scroll_offset = 0;
-
-            render_ui(&config, &plist, last_cpu_usage, have_mem_info ? &last_mem_info : NULL,
-                     have_cpu_info ? &cpu_info : NULL, selected_row, scroll_offset, &visible_rows, &total_rows, view_mode);
+            // Only the rows up to the bottom of the window need a full order
+            int window = visible_rows > 0 ? visible_rows : LINES;
+            sampler_set_visible_rows(&sampler, (size_t)(scroll_offset + window));
+            process_list_ensure_sorted(&snap->list, &config, (size_t)(scroll_offset + LINES));
+
+            render_ui(&config, plist, snap->cpu_usage, snap->have_mem_info ? &snap->mem_info : NULL,
+                     snap->have_cpu_info ? &snap->cpu_info : NULL, selected_row, scroll_offset, &visible_rows, &total_rows, view_mode, &prompt,
+                     snap->tick_lateness, snap->ticks_missed, (int)(snap->refresh_interval * 1000.0 + 0.5));
+            if (snap->failed) {
+                mvprintw(1, 2, "Failed to read processes.");
+                refresh();
+            }
         }
     }
 
-    process_list_free(&plist);
-    process_cache_free(&cache);
-    cpu_info_free(&cpu_info);
+    sampler_stop(&sampler);
+    if (config.refresh_adaptive)
+        set_focus_reports(false);
     endwin();
     return 0;
 }
\ No newline at end of file
@@ -0,0 +1,276 @@
+#define _GNU_SOURCE
+
+#include "proc_events.h"
+
+#include <errno.h>
+#include <poll.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <linux/cn_proc.h>
+#include <linux/connector.h>
+#include <linux/netlink.h>
+
+void proc_events_init(proc_events *ev) {
+    if (!ev)
+        return;
+    memset(ev, 0, sizeof(*ev));
+    ev->sock = -1;
+}
+
+void proc_events_close(proc_events *ev) {
+    if (!ev)
+        return;
+    if (ev->sock >= 0)
+        close(ev->sock);
+    free(ev->set);
+    free(ev->sorted);
+    free(ev->execs);
+    proc_events_init(ev);
+}
+
+static int send_mcast_op(int sock, enum proc_cn_mcast_op op) {
+    char buf[NLMSG_SPACE(sizeof(struct cn_msg) + sizeof(op))] __attribute__((aligned(8)));
+    memset(buf, 0, sizeof(buf));
+    struct nlmsghdr *nl = (struct nlmsghdr *)buf;
+    nl->nlmsg_len = NLMSG_LENGTH(sizeof(struct cn_msg) + sizeof(op));
+    nl->nlmsg_type = NLMSG_DONE;
+    struct cn_msg *cn = NLMSG_DATA(nl);
+    cn->id.idx = CN_IDX_PROC;
+    cn->id.val = CN_VAL_PROC;
+    cn->len = sizeof(op);
+    memcpy(cn->data, &op, sizeof(op));
+    return send(sock, buf, nl->nlmsg_len, 0) < 0 ? -1 : 0;
+}
+
+/* The kernel acknowledges PROC_CN_MCAST_LISTEN with a PROC_EVENT_NONE
+ * carrying an errno; no acknowledgement at all means the request was
+ * ignored (e.g. when running outside the initial PID namespace). */
+static int wait_for_ack(int sock) {
+    char buf[4096] __attribute__((aligned(8)));
+    struct pollfd pfd = {.fd = sock, .events = POLLIN};
+    for (int tries = 0; tries < 8; ++tries) {
+        if (poll(&pfd, 1, 100) <= 0)
+            return -1;
+        ssize_t len = recv(sock, buf, sizeof(buf), 0);
+        if (len <= 0)
+            return -1;
+        for (struct nlmsghdr *nl = (struct nlmsghdr *)buf; NLMSG_OK(nl, (size_t)len);
+             nl = NLMSG_NEXT(nl, len)) {
+            struct cn_msg *cn = NLMSG_DATA(nl);
+            if (cn->id.idx != CN_IDX_PROC || cn->id.val != CN_VAL_PROC)
+                continue;
+            const struct proc_event *pe = (const struct proc_event *)cn->data;
+            if (pe->what == PROC_EVENT_NONE)
+                return pe->event_data.ack.err == 0 ? 0 : -1;
+        }
+    }
+    return -1;
+}
+
+int proc_events_open(proc_events *ev) {
+    if (!ev)
+        return -1;
+    if (ev->sock >= 0)
+        return 0;
+    if (ev->failed)
+        return -1;
+
+    int sock = socket(PF_NETLINK, SOCK_DGRAM | SOCK_CLOEXEC, NETLINK_CONNECTOR);
+    if (sock < 0)
+        goto fail;
+
+    struct sockaddr_nl addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.nl_family = AF_NETLINK;
+    addr.nl_groups = CN_IDX_PROC;
+    if (bind(sock, (struct sockaddr *)&addr, sizeof(addr)) != 0)
+        goto fail;
+    if (send_mcast_op(sock, PROC_CN_MCAST_LISTEN) != 0 || wait_for_ack(sock) != 0)
+        goto fail;
+
+    /* generous receive buffer: a fork storm must not overflow between refreshes */
+    int rcvbuf = 4 * 1024 * 1024;
+    setsockopt(sock, SOL_SOCKET, SO_RCVBUFFORCE, &rcvbuf, sizeof(rcvbuf));
+    ev->sock = sock;
+    ev->stale = true; /* nothing known yet */
+    return 0;
+
+fail:
+    if (sock >= 0)
+        close(sock);
+    ev->failed = true;
+    return -1;
+}
+
+static size_t pid_slot(pid_t pid, size_t capacity) {
+    unsigned long long h = (unsigned long long)(unsigned int)pid * 11400714819323198485ull;
+    return (size_t)(h >> 32) & (capacity - 1);
+}
+
+static int set_grow(proc_events *ev) {
+    size_t new_cap = ev->capacity ? ev->capacity * 2 : 1024;
+    pid_t *set = calloc(new_cap, sizeof(pid_t));
+    if (!set)
+        return -1;
+    for (size_t i = 0; i < ev->capacity; ++i) {
+        if (ev->set[i] == 0)
+            continue;
+        size_t j = pid_slot(ev->set[i], new_cap);
+        while (set[j] != 0)
+            j = (j + 1) & (new_cap - 1);
+        set[j] = ev->set[i];
+    }
+    free(ev->set);
+    ev->set = set;
+    ev->capacity = new_cap;
+    return 0;
+}
+
+void proc_events_clear(proc_events *ev) {
+    if (!ev)
+        return;
+    if (ev->set)
+        memset(ev->set, 0, ev->capacity * sizeof(pid_t));
+    ev->count = 0;
+    ev->stale = false;
+}
+
+int proc_events_add(proc_events *ev, pid_t pid) {
+    if (!ev || pid <= 0)
+        return -1;
+    if ((ev->count + 1) * 2 > ev->capacity && set_grow(ev) != 0) {
+        ev->stale = true;
+        return -1;
+    }
+    size_t mask = ev->capacity - 1;
+    size_t i = pid_slot(pid, ev->capacity);
+    while (ev->set[i] != 0) {
+        if (ev->set[i] == pid)
+            return 0;
+        i = (i + 1) & mask;
+    }
+    ev->set[i] = pid;
+    ev->count++;
+    return 0;
+}
+
+void proc_events_remove(proc_events *ev, pid_t pid) {
+    if (!ev || ev->capacity == 0 || pid <= 0)
+        return;
+    size_t mask = ev->capacity - 1;
+    size_t hole = pid_slot(pid, ev->capacity);
+    while (ev->set[hole] != pid) {
+        if (ev->set[hole] == 0)
+            return;
+        hole = (hole + 1) & mask;
+    }
+    /* backward-shift deletion, see cache_remove_at() in process.c */
+    for (size_t i = (hole + 1) & mask; ev->set[i] != 0; i = (i + 1) & mask) {
+        size_t home = pid_slot(ev->set[i], ev->capacity);
+        if (((i - home) & mask) < ((i - hole) & mask))
+            continue;
+        ev->set[hole] = ev->set[i];
+        hole = i;
+    }
+    ev->set[hole] = 0;
+    ev->count--;
+}
+
+static void note_exec(proc_events *ev, pid_t pid) {
+    if (ev->exec_count == ev->exec_capacity) {
+        size_t new_cap = ev->exec_capacity ? ev->exec_capacity * 2 : 64;
+        pid_t *execs = realloc(ev->execs, new_cap * sizeof(pid_t));
+        if (!execs) {
+            ev->execs_lost = true;
+            return;
+        }
+        ev->execs = execs;
+        ev->exec_capacity = new_cap;
+    }
+    ev->execs[ev->exec_count++] = pid;
+}
+
+static void apply_event(proc_events *ev, const struct proc_event *pe) {
+    switch (pe->what) {
+        case PROC_EVENT_FORK:
+            /* thread creation shows up as a fork with child_pid != child_tgid */
+            if (pe->event_data.fork.child_pid == pe->event_data.fork.child_tgid)
+                proc_events_add(ev, pe->event_data.fork.child_tgid);
+            break;
+        case PROC_EVENT_EXIT:
+            if (pe->event_data.exit.process_pid == pe->event_data.exit.process_tgid)
+                proc_events_remove(ev, pe->event_data.exit.process_tgid);
+            break;
+        case PROC_EVENT_EXEC:
+            /* any thread may exec; the process keeps its tgid */
+            note_exec(ev, pe->event_data.exec.process_tgid);
+            break;
+        default:
+            break;
+    }
+}
+
+void proc_events_poll(proc_events *ev) {
+    if (!ev || ev->sock < 0)
+        return;
+    ev->exec_count = 0;
+    ev->execs_lost = false;
+    char buf[16384] __attribute__((aligned(8)));
+    for (;;) {
+        ssize_t len = recv(ev->sock, buf, sizeof(buf), MSG_DONTWAIT);
+        if (len < 0) {
+            if (errno == EINTR)
+                continue;
+            if (errno == ENOBUFS) {
+                /* the socket overflowed; keep draining, then rescan */
+                ev->stale = true;
+                ev->execs_lost = true;
+                continue;
+            }
+            break; /* EAGAIN: queue drained */
+        }
+        if (len == 0)
+            break;
+        for (struct nlmsghdr *nl = (struct nlmsghdr *)buf; NLMSG_OK(nl, (size_t)len);
+             nl = NLMSG_NEXT(nl, len)) {
+            if (nl->nlmsg_type == NLMSG_ERROR || nl->nlmsg_type == NLMSG_NOOP)
+                continue;
+            struct cn_msg *cn = NLMSG_DATA(nl);
+            if (cn->id.idx != CN_IDX_PROC || cn->id.val != CN_VAL_PROC)
+                continue;
+            apply_event(ev, (const struct proc_event *)cn->data);
+        }
+    }
+}
+
+static int pid_cmp(const void *lhs, const void *rhs) {
+    pid_t a = *(const pid_t *)lhs;
+    pid_t b = *(const pid_t *)rhs;
+    return (a > b) - (a < b);
+}
+
+const pid_t *proc_events_pids(proc_events *ev, size_t *count) {
+    if (count)
+        *count = 0;
+    if (!ev || !count)
+        return NULL;
+    if (ev->count > 0 && ev->sorted_capacity < ev->count) {
+        pid_t *sorted = realloc(ev->sorted, ev->count * sizeof(pid_t));
+        if (!sorted)
+            return NULL;
+        ev->sorted = sorted;
+        ev->sorted_capacity = ev->count;
+    }
+    size_t n = 0;
+    for (size_t i = 0; i < ev->capacity; ++i) {
+        if (ev->set[i] != 0)
+            ev->sorted[n++] = ev->set[i];
+    }
+    qsort(ev->sorted, n, sizeof(pid_t), pid_cmp);
+    *count = n;
+    return ev->sorted;
+}
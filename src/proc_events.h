@@ -0,0 +1,43 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <sys/types.h>
+
+/* Live set of process IDs maintained from the kernel proc connector
+ * (PROC_EVENT_FORK / PROC_EVENT_EXIT over NETLINK_CONNECTOR), plus the
+ * processes that called exec since the last poll. Subscribing
+ * requires CAP_NET_ADMIN in the initial namespaces; callers fall back to
+ * walking /proc when proc_events_open() fails. */
+typedef struct {
+    int sock;         /* -1 when not subscribed */
+    bool failed;      /* subscribing failed once; do not retry */
+    bool stale;       /* events were dropped, the set needs a full rescan */
+    pid_t *set;       /* open-addressing set, 0 marks an empty slot */
+    size_t count;
+    size_t capacity;
+    pid_t *sorted;    /* scratch returned by proc_events_pids() */
+    size_t sorted_capacity;
+    pid_t *execs;     /* PROC_EVENT_EXEC of the last poll, may repeat a PID */
+    size_t exec_count;
+    size_t exec_capacity;
+    bool execs_lost;  /* the last poll could not record every exec */
+} proc_events;
+
+void proc_events_init(proc_events *ev);
+void proc_events_close(proc_events *ev);
+
+// Subscribe to process events; returns 0 on success, -1 if unavailable.
+int proc_events_open(proc_events *ev);
+
+// Apply all queued events to the PID set without blocking. Replaces the
+// exec list with the execs among them.
+void proc_events_poll(proc_events *ev);
+
+// Replace the set, e.g. after a full /proc walk.
+void proc_events_clear(proc_events *ev);
+int proc_events_add(proc_events *ev, pid_t pid);
+void proc_events_remove(proc_events *ev, pid_t pid);
+
+// Current PIDs in ascending order, valid until the next call.
+const pid_t *proc_events_pids(proc_events *ev, size_t *count);
@@ -3,15 +3,21 @@
 #include "process.h"
 
 #include "config.h"
+#include "filter.h"
+#include "procfs.h"
 
-#include <ctype.h>
 #include <dirent.h>
 #include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
 #include <pwd.h>
 #include <errno.h>
+#include <signal.h>
+#include <stdatomic.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/resource.h>
 #include <sys/stat.h>
 #include <unistd.h>
 
@@ -41,24 +47,40 @@ static void ensure_system_constants(void) {
 void process_list_init(process_list *list) {
     if (!list)
         return;
-    list->items = NULL;
-    list->count = 0;
-    list->capacity = 0;
+    memset(list, 0, sizeof(*list));
 }
 
 void process_list_clear(process_list *list) {
     if (!list)
         return;
     list->count = 0;
+    list->rows = 0;
+    list->sorted = 0;
 }
 
 void process_list_free(process_list *list) {
     if (!list)
         return;
-    free(list->items);
-    list->items = NULL;
-    list->count = 0;
-    list->capacity = 0;
+    free(list->pid);
+    free(list->ppid);
+    free(list->cpu_percent);
+    free(list->mem_percent);
+    free(list->rss_kb);
+    free(list->detail);
+    free(list->order);
+    free(list->parent);
+    free(list->first_child);
+    free(list->next_sibling);
+    free(list->index);
+    process_list_init(list);
+}
+
+const char *process_list_user(const process_list *list, size_t row) {
+    return intern_str(list->strings, list->detail[row].user);
+}
+
+const char *process_list_command(const process_list *list, size_t row) {
+    return intern_str(list->strings, list->detail[row].command);
 }
 
 void process_cache_init(process_cache *cache) {
@@ -67,84 +89,570 @@ void process_cache_init(process_cache *cache) {
     cache->entries = NULL;
     cache->count = 0;
     cache->capacity = 0;
+    cache->generation = 0;
+    cache->fd_slots = NULL;
+    cache->fd_slot_count = 0;
+    cache->fd_lru_head = -1;
+    cache->fd_lru_tail = -1;
+    cache->fd_free = -1;
+    cache->task_fd_budget = 0;
+    cache->task_fds = 0;
+    cache->samples = NULL;
+    cache->sample_count = 0;
+    cache->sample_capacity = 0;
+    cache->pool = NULL;
+    cache->visible_rows = 0;
+    cache->field_mask = 0;
+    cache->mask_columns[0] = '\0';
+    cache->mask_sort = -1;
+    cache->mask_valid = false;
+    cache->background = false;
+    cache->filter = NULL;
+    memset(&cache->users, 0, sizeof(cache->users));
+    intern_pool_init(&cache->strings);
+    cache->unknown_user = 0;
+    procfs_pid_scan_init(&cache->pid_scan);
+    proc_events_init(&cache->events);
+    cache->refreshes_since_rescan = 0;
+    cache->smaps_cursor = 0;
+    cache->scan_active = false;
+    cache->scan_next = 0;
+    cache->scan_from_events = false;
+    cache->scan_names_flushed = false;
+    cache->pass_born = 0;
+    cache->pass_exited = 0;
 }
 
+static void fd_slots_free(process_cache *cache);
+static void scan_pool_destroy(struct scan_pool *pool);
+
 void process_cache_free(process_cache *cache) {
     if (!cache)
         return;
+    scan_pool_destroy(cache->pool);
+    cache->pool = NULL;
+    cache->mask_valid = false;
+    filter_free(cache->filter);
+    cache->filter = NULL;
+    free(cache->users.entries);
+    memset(&cache->users, 0, sizeof(cache->users));
+    intern_pool_free(&cache->strings);
+    cache->unknown_user = 0;
+    procfs_pid_scan_free(&cache->pid_scan);
+    proc_events_close(&cache->events);
+    cache->refreshes_since_rescan = 0;
+    fd_slots_free(cache);
+    for (size_t i = 0; i < cache->sample_capacity; ++i)
+        free(cache->samples[i].tasks);
+    free(cache->samples);
+    cache->samples = NULL;
+    cache->sample_count = 0;
+    cache->sample_capacity = 0;
+    for (size_t i = 0; i < cache->capacity; ++i)
+        free(cache->entries[i].tasks);
     free(cache->entries);
     cache->entries = NULL;
     cache->count = 0;
     cache->capacity = 0;
+    cache->generation = 0;
 }
 
-static int ensure_cache_capacity(process_cache *cache, size_t needed) {
-    if (cache->capacity >= needed)
-        return 0;
-    size_t new_cap = cache->capacity ? cache->capacity * 2 : 256;
-    while (new_cap < needed)
-        new_cap *= 2;
-    proc_cpu_entry *entries = realloc(cache->entries, new_cap * sizeof(proc_cpu_entry));
+static size_t cache_slot(pid_t pid, size_t capacity) {
+    /* Fibonacci hashing spreads sequential PIDs across the table */
+    unsigned long long h = (unsigned long long)(unsigned int)pid * 11400714819323198485ull;
+    return (size_t)(h >> 32) & (capacity - 1);
+}
+
+static proc_cpu_entry *cache_find(const process_cache *cache, pid_t pid) {
+    if (!cache || cache->capacity == 0)
+        return NULL;
+    size_t mask = cache->capacity - 1;
+    for (size_t i = cache_slot(pid, cache->capacity);; i = (i + 1) & mask) {
+        proc_cpu_entry *entry = &cache->entries[i];
+        if (entry->pid == pid)
+            return entry;
+        if (entry->pid == 0)
+            return NULL;
+    }
+}
+
+static int cache_grow(process_cache *cache) {
+    size_t new_cap = cache->capacity ? cache->capacity * 2 : 1024;
+    proc_cpu_entry *entries = calloc(new_cap, sizeof(proc_cpu_entry));
     if (!entries)
         return -1;
+    for (size_t i = 0; i < cache->capacity; ++i) {
+        const proc_cpu_entry *old = &cache->entries[i];
+        if (old->pid == 0)
+            continue;
+        size_t j = cache_slot(old->pid, new_cap);
+        while (entries[j].pid != 0)
+            j = (j + 1) & (new_cap - 1);
+        entries[j] = *old;
+    }
+    free(cache->entries);
     cache->entries = entries;
     cache->capacity = new_cap;
     return 0;
 }
 
+/* Returns the entry for pid, inserting a zeroed one if it is not present. */
+static proc_cpu_entry *cache_insert(process_cache *cache, pid_t pid) {
+    proc_cpu_entry *entry = cache_find(cache, pid);
+    if (entry)
+        return entry;
+    /* keep the load factor at or below 1/2 so probe chains stay short */
+    if ((cache->count + 1) * 2 > cache->capacity && cache_grow(cache) != 0)
+        return NULL;
+    size_t mask = cache->capacity - 1;
+    size_t i = cache_slot(pid, cache->capacity);
+    while (cache->entries[i].pid != 0)
+        i = (i + 1) & mask;
+    entry = &cache->entries[i];
+    memset(entry, 0, sizeof(*entry));
+    entry->pid = pid;
+    entry->fd_slot = -1;
+    cache->count++;
+    return entry;
+}
+
+/* Backward-shift deletion: pull later members of the probe chain into the
+ * hole so lookups never need tombstones. */
+static void cache_remove_at(process_cache *cache, size_t hole) {
+    size_t mask = cache->capacity - 1;
+    size_t i = hole;
+    for (;;) {
+        i = (i + 1) & mask;
+        proc_cpu_entry *entry = &cache->entries[i];
+        if (entry->pid == 0)
+            break;
+        size_t home = cache_slot(entry->pid, cache->capacity);
+        /* leave entries whose home lies cyclically in (hole, i] */
+        if (((i - home) & mask) < ((i - hole) & mask))
+            continue;
+        cache->entries[hole] = *entry;
+        hole = i;
+    }
+    memset(&cache->entries[hole], 0, sizeof(cache->entries[hole]));
+    cache->count--;
+}
+
+static void close_fds(int *fds) {
+    for (int f = 0; f < PROC_FILE_COUNT; ++f) {
+        if (fds[f] >= 0)
+            close(fds[f]);
+        fds[f] = -1;
+    }
+}
+
+/* Closes the thread descriptors in tasks and returns how many were open. */
+static long close_task_fds(proc_task_sched *tasks, size_t count) {
+    long closed = 0;
+    for (size_t i = 0; i < count; ++i) {
+        if (tasks[i].fd >= 0) {
+            close(tasks[i].fd);
+            closed++;
+        }
+        tasks[i].fd = -1;
+    }
+    return closed;
+}
+
+static long count_task_fds(const proc_task_sched *tasks, size_t count) {
+    long open = 0;
+    for (size_t i = 0; i < count; ++i)
+        open += tasks[i].fd >= 0;
+    return open;
+}
+
+/* Thread descriptors go with the process's slot; the counters stay. */
+static void entry_task_fds_close(process_cache *cache, proc_cpu_entry *entry) {
+    cache->task_fds -= close_task_fds(entry->tasks, entry->task_count);
+}
+
+static void fd_slots_free(process_cache *cache) {
+    for (int i = 0; i < cache->fd_slot_count; ++i)
+        close_fds(cache->fd_slots[i].fds);
+    for (size_t i = 0; i < cache->capacity; ++i) {
+        cache->entries[i].fd_slot = -1;
+        entry_task_fds_close(cache, &cache->entries[i]);
+    }
+    free(cache->fd_slots);
+    cache->fd_slots = NULL;
+    cache->fd_slot_count = 0;
+    cache->fd_lru_head = -1;
+    cache->fd_lru_tail = -1;
+    cache->fd_free = -1;
+}
+
+/* Sizes the slot pool for the configured budget, releasing it when the
+ * budget changes or persistent descriptors are turned off. While schedstat
+ * is read, half of the budget is left for the files of single threads. */
+static void fd_slots_configure(process_cache *cache, const cupid_config *config) {
+    int wanted = 0;
+    cache->task_fd_budget = 0;
+    if (config->persistent_fds) {
+        long budget = config->fd_budget;
+        struct rlimit rl;
+        if (getrlimit(RLIMIT_NOFILE, &rl) == 0 && rl.rlim_cur != RLIM_INFINITY &&
+            (long)rl.rlim_cur - 64 < budget)
+            budget = (long)rl.rlim_cur - 64;
+        if (budget > 0 && (cache->field_mask & PROC_FIELD_SCHEDSTAT)) {
+            cache->task_fd_budget = budget / 2;
+            budget -= cache->task_fd_budget;
+        }
+        wanted = budget > 0 ? (int)(budget / PROC_FILE_COUNT) : 0;
+    }
+    if (wanted == cache->fd_slot_count)
+        return;
+    fd_slots_free(cache);
+    if (wanted == 0)
+        return;
+    cache->fd_slots = malloc((size_t)wanted * sizeof(proc_fd_slot));
+    if (!cache->fd_slots)
+        return;
+    cache->fd_slot_count = wanted;
+    for (int i = 0; i < wanted; ++i) {
+        proc_fd_slot *slot = &cache->fd_slots[i];
+        slot->pid = 0;
+        for (int f = 0; f < PROC_FILE_COUNT; ++f)
+            slot->fds[f] = -1;
+        slot->generation = 0;
+        slot->prev = -1;
+        slot->next = i + 1 < wanted ? i + 1 : -1;
+    }
+    cache->fd_free = 0;
+}
+
+static void fd_lru_unlink(process_cache *cache, int idx) {
+    proc_fd_slot *slot = &cache->fd_slots[idx];
+    if (slot->prev >= 0)
+        cache->fd_slots[slot->prev].next = slot->next;
+    else
+        cache->fd_lru_head = slot->next;
+    if (slot->next >= 0)
+        cache->fd_slots[slot->next].prev = slot->prev;
+    else
+        cache->fd_lru_tail = slot->prev;
+    slot->prev = slot->next = -1;
+}
+
+static void fd_lru_push_front(process_cache *cache, int idx) {
+    proc_fd_slot *slot = &cache->fd_slots[idx];
+    slot->prev = -1;
+    slot->next = cache->fd_lru_head;
+    if (cache->fd_lru_head >= 0)
+        cache->fd_slots[cache->fd_lru_head].prev = idx;
+    cache->fd_lru_head = idx;
+    if (cache->fd_lru_tail < 0)
+        cache->fd_lru_tail = idx;
+}
+
+static void fd_slot_release(process_cache *cache, proc_cpu_entry *entry) {
+    int idx = entry->fd_slot;
+    if (idx < 0)
+        return;
+    proc_fd_slot *slot = &cache->fd_slots[idx];
+    close_fds(slot->fds);
+    entry_task_fds_close(cache, entry);
+    slot->pid = 0;
+    fd_lru_unlink(cache, idx);
+    slot->next = cache->fd_free;
+    cache->fd_free = idx;
+    entry->fd_slot = -1;
+}
+
+/* Takes a free slot, or recycles the least recently used one as long as it
+ * was not already used during this refresh; recycling slots that the scan
+ * is still going to need would just make every process reopen its files. */
+static int fd_slot_acquire(process_cache *cache) {
+    int idx = cache->fd_free;
+    if (idx >= 0) {
+        cache->fd_free = cache->fd_slots[idx].next;
+        return idx;
+    }
+    idx = cache->fd_lru_tail;
+    if (idx < 0 || cache->fd_slots[idx].generation == cache->generation)
+        return -1;
+    proc_cpu_entry *owner = cache_find(cache, cache->fd_slots[idx].pid);
+    if (owner && owner->fd_slot == idx) {
+        owner->fd_slot = -1;
+        entry_task_fds_close(cache, owner);
+    }
+    close_fds(cache->fd_slots[idx].fds);
+    fd_lru_unlink(cache, idx);
+    return idx;
+}
+
+/* Hands the descriptors used while sampling a process back to its slot.
+ * Descriptors that cannot be kept are closed. */
+static void fd_slot_store(process_cache *cache, proc_cpu_entry *entry, int *fds) {
+    if (!entry) {
+        close_fds(fds);
+        return;
+    }
+    int idx = entry->fd_slot;
+    if (idx < 0) {
+        idx = fd_slot_acquire(cache);
+        if (idx < 0) {
+            close_fds(fds);
+            return;
+        }
+        entry->fd_slot = idx;
+        cache->fd_slots[idx].pid = entry->pid;
+    } else {
+        fd_lru_unlink(cache, idx);
+    }
+    proc_fd_slot *slot = &cache->fd_slots[idx];
+    memcpy(slot->fds, fds, sizeof(slot->fds));
+    slot->generation = cache->generation;
+    fd_lru_push_front(cache, idx);
+}
+
+/* Drop every process that was not seen during the current refresh. */
+static void cache_sweep(process_cache *cache) {
+    for (size_t i = 0; i < cache->capacity; ++i) {
+        while (cache->entries[i].pid != 0 &&
+               cache->entries[i].generation != cache->generation) {
+            fd_slot_release(cache, &cache->entries[i]);
+            entry_task_fds_close(cache, &cache->entries[i]);
+            free(cache->entries[i].tasks);
+            intern_release(&cache->strings, cache->entries[i].command);
+            cache_remove_at(cache, i);
+            cache->pass_exited++;
+        }
+    }
+}
+
+/* The PID was reused, or is new: forget everything learned about its
+ * previous owner. */
+static void cache_entry_reset(process_cache *cache, proc_cpu_entry *entry) {
+    cache->pass_born++;
+    intern_release(&cache->strings, entry->command);
+    entry->command = 0;
+    entry->command_full = false;
+    entry->comm[0] = '\0';
+    entry->smaps_denied = false;
+    entry->pss_kb = 0;
+    entry->uss_kb = 0;
+    entry->swap_pss_kb = 0;
+    entry->smaps_time = 0.0;
+    entry->io_denied = false;
+    entry->io_valid = false;
+    entry->sched_valid = false;
+    entry_task_fds_close(cache, entry);
+    entry->task_count = 0;
+}
+
+static const char *const proc_file_names[PROC_FILE_COUNT] = {"stat", "status", "cmdline", "io",
+                                                              "schedstat"};
+
+/* Reads up to buflen - 1 bytes of /proc/<pid>/<file> into buffer and NUL
+ * terminates it. With fd == NULL the file is opened and closed again;
+ * otherwise *fd is re-read with pread() and replaced by a fresh descriptor
+ * when it is missing or stale. Returns the byte count or -1. */
+static ssize_t read_proc_file(pid_t pid, int file, int *fd, char *buffer, size_t buflen) {
+    if (!buffer || buflen == 0)
+        return -1;
+    buffer[0] = '\0';
+
+    if (fd && *fd >= 0) {
+        ssize_t n = pread(*fd, buffer, buflen - 1, 0);
+        if (n >= 0) {
+            buffer[n] = '\0';
+            return n;
+        }
+        /* ESRCH: the process behind the descriptor is gone; the PID may
+         * belong to a new process by now, so reopen below. */
+        close(*fd);
+        *fd = -1;
+    }
+
+    char path[64];
+    snprintf(path, sizeof(path), "/proc/%d/%s", pid, proc_file_names[file]);
+    int local_fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (local_fd < 0)
+        return -1;
+    ssize_t n = pread(local_fd, buffer, buflen - 1, 0);
+    if (fd && n >= 0)
+        *fd = local_fd;
+    else
+        close(local_fd);
+    if (n < 0)
+        return -1;
+    buffer[n] = '\0';
+    return n;
+}
+
+static int grow_column(void **column, size_t elem_size, size_t count) {
+    void *grown = realloc(*column, count * elem_size);
+    if (!grown)
+        return -1;
+    *column = grown;
+    return 0;
+}
+
 static int ensure_list_capacity(process_list *list, size_t needed) {
     if (list->capacity >= needed)
         return 0;
     size_t new_cap = list->capacity ? list->capacity * 2 : 256;
     while (new_cap < needed)
         new_cap *= 2;
-    process_info *items = realloc(list->items, new_cap * sizeof(process_info));
-    if (!items)
+    /* a failed step leaves the earlier columns larger, which is harmless */
+    if (grow_column((void **)&list->pid, sizeof(*list->pid), new_cap) != 0 ||
+        grow_column((void **)&list->ppid, sizeof(*list->ppid), new_cap) != 0 ||
+        grow_column((void **)&list->cpu_percent, sizeof(*list->cpu_percent), new_cap) != 0 ||
+        grow_column((void **)&list->mem_percent, sizeof(*list->mem_percent), new_cap) != 0 ||
+        grow_column((void **)&list->rss_kb, sizeof(*list->rss_kb), new_cap) != 0 ||
+        grow_column((void **)&list->detail, sizeof(*list->detail), new_cap) != 0 ||
+        grow_column((void **)&list->order, sizeof(*list->order), new_cap) != 0 ||
+        grow_column((void **)&list->parent, sizeof(*list->parent), new_cap) != 0 ||
+        grow_column((void **)&list->first_child, sizeof(*list->first_child), new_cap) != 0 ||
+        grow_column((void **)&list->next_sibling, sizeof(*list->next_sibling), new_cap) != 0)
         return -1;
-    list->items = items;
     list->capacity = new_cap;
     return 0;
 }
 
-static unsigned long long cache_lookup(process_cache *cache, pid_t pid, bool *found) {
-    if (found)
-        *found = false;
-    if (!cache || cache->count == 0)
-        return 0;
-    for (size_t i = 0; i < cache->count; ++i) {
-        if (cache->entries[i].pid == pid) {
-            if (found)
-                *found = true;
-            return cache->entries[i].total_ticks;
-        }
+size_t process_list_find(const process_list *list, pid_t pid) {
+    if (!list || list->index_capacity == 0)
+        return PROCESS_ROW_NONE;
+    size_t mask = list->index_capacity - 1;
+    for (size_t i = cache_slot(pid, list->index_capacity); list->index[i] != 0; i = (i + 1) & mask) {
+        size_t row = list->index[i] - 1;
+        /* rows past list->rows are left over from before a clear */
+        if (row < list->rows && list->pid[row] == pid)
+            return row;
     }
-    return 0;
+    return PROCESS_ROW_NONE;
 }
 
-static int cache_append(process_cache *cache, pid_t pid, unsigned long long ticks) {
-    if (!cache)
-        return -1;
-    if (ensure_cache_capacity(cache, cache->count + 1) != 0)
+int process_list_copy(process_list *dst, const process_list *src) {
+    if (!dst || !src || ensure_list_capacity(dst, src->rows) != 0)
         return -1;
-    cache->entries[cache->count].pid = pid;
-    cache->entries[cache->count].total_ticks = ticks;
-    cache->count++;
+    /* the index hashes by its capacity, so it has to match exactly */
+    if (dst->index_capacity != src->index_capacity) {
+        size_t *index = realloc(dst->index, src->index_capacity * sizeof(size_t));
+        if (src->index_capacity > 0 && !index)
+            return -1;
+        dst->index = index;
+        dst->index_capacity = src->index_capacity;
+    }
+    size_t rows = src->rows;
+    if (rows > 0) {
+        memcpy(dst->pid, src->pid, rows * sizeof(*src->pid));
+        memcpy(dst->ppid, src->ppid, rows * sizeof(*src->ppid));
+        memcpy(dst->cpu_percent, src->cpu_percent, rows * sizeof(*src->cpu_percent));
+        memcpy(dst->mem_percent, src->mem_percent, rows * sizeof(*src->mem_percent));
+        memcpy(dst->rss_kb, src->rss_kb, rows * sizeof(*src->rss_kb));
+        memcpy(dst->detail, src->detail, rows * sizeof(*src->detail));
+        memcpy(dst->order, src->order, rows * sizeof(*src->order));
+        memcpy(dst->parent, src->parent, rows * sizeof(*src->parent));
+        memcpy(dst->first_child, src->first_child, rows * sizeof(*src->first_child));
+        memcpy(dst->next_sibling, src->next_sibling, rows * sizeof(*src->next_sibling));
+    }
+    if (src->index_capacity > 0)
+        memcpy(dst->index, src->index, src->index_capacity * sizeof(size_t));
+    dst->count = src->count;
+    dst->rows = src->rows;
+    dst->sorted = src->sorted;
+    dst->strings = src->strings;
     return 0;
 }
 
-static void cache_replace(process_cache *cache, process_cache *replacement) {
-    if (!cache || !replacement)
-        return;
-    free(cache->entries);
-    *cache = *replacement;
-    replacement->entries = NULL;
-    replacement->count = 0;
-    replacement->capacity = 0;
+/* Hashes every row by pid and resolves each row's parent, once per
+ * refresh, so neither the aggregation nor the tree view searches. */
+static int index_parents(process_list *list) {
+    size_t needed = 16;
+    while (needed < list->rows * 2)
+        needed *= 2;
+    if (list->index_capacity < needed) {
+        size_t *index = realloc(list->index, needed * sizeof(size_t));
+        if (!index)
+            return -1;
+        list->index = index;
+        list->index_capacity = needed;
+    }
+    memset(list->index, 0, list->index_capacity * sizeof(size_t));
+    size_t mask = list->index_capacity - 1;
+    for (size_t row = 0; row < list->rows; ++row) {
+        size_t i = cache_slot(list->pid[row], list->index_capacity);
+        while (list->index[i] != 0)
+            i = (i + 1) & mask;
+        list->index[i] = row + 1;
+    }
+    for (size_t row = 0; row < list->rows; ++row) {
+        size_t parent = process_list_find(list, list->ppid[row]);
+        list->parent[row] = parent == row ? PROCESS_ROW_NONE : parent;
+    }
+    return 0;
 }
 
-static void username_for_uid(uid_t uid, char *buffer, size_t buflen) {
+/* Threads the listed rows into sibling lists in display order. Rows cut
+ * by max_processes are marked so their children become roots. */
+#define ROW_CUT (PROCESS_ROW_NONE - 1)
+
+static void link_children(process_list *list) {
+    for (size_t row = 0; row < list->rows; ++row) {
+        list->first_child[row] = PROCESS_ROW_NONE;
+        list->next_sibling[row] = PROCESS_ROW_NONE;
+    }
+    for (size_t pos = list->count; pos < list->rows; ++pos)
+        list->first_child[list->order[pos]] = ROW_CUT;
+    for (size_t pos = list->count; pos-- > 0;) {
+        size_t row = list->order[pos];
+        size_t parent = list->parent[row];
+        if (parent == PROCESS_ROW_NONE)
+            continue;
+        if (list->first_child[parent] == ROW_CUT) {
+            list->parent[row] = PROCESS_ROW_NONE;
+            continue;
+        }
+        list->next_sibling[row] = list->first_child[parent];
+        list->first_child[parent] = row;
+    }
+    for (size_t pos = list->count; pos < list->rows; ++pos)
+        list->first_child[list->order[pos]] = PROCESS_ROW_NONE;
+}
+
+/* Sums CPU, RSS and threads over every subtree in one post-order walk of
+ * the row-order child links: a row is final once its last child is, and
+ * then adds itself into its parent. Rows on a ppid cycle are never
+ * reached and keep their own values. */
+static void rollup_subtrees(process_list *list) {
+    for (size_t row = 0; row < list->rows; ++row) {
+        process_detail *detail = &list->detail[row];
+        detail->cpu_tree = detail->cpu_own;
+        detail->rss_tree = list->rss_kb[row];
+        detail->threads_tree = detail->threads;
+    }
+    link_children(list);
+    for (size_t root = 0; root < list->rows; ++root) {
+        if (list->parent[root] != PROCESS_ROW_NONE)
+            continue;
+        size_t row = root;
+        while (list->first_child[row] != PROCESS_ROW_NONE)
+            row = list->first_child[row];
+        while (row != root) {
+            size_t parent = list->parent[row];
+            process_detail *up = &list->detail[parent];
+            up->cpu_tree += list->detail[row].cpu_tree;
+            up->rss_tree += list->detail[row].rss_tree;
+            up->threads_tree += list->detail[row].threads_tree;
+            if (list->next_sibling[row] != PROCESS_ROW_NONE) {
+                row = list->next_sibling[row];
+                while (list->first_child[row] != PROCESS_ROW_NONE)
+                    row = list->first_child[row];
+            } else {
+                row = parent;
+            }
+        }
+    }
+}
+
+static bool username_for_uid(uid_t uid, char *buffer, size_t buflen) {
     if (!buffer || buflen == 0)
-        return;
+        return false;
     buffer[0] = '\0';
 
     struct passwd pwd;
@@ -153,20 +661,101 @@ static void username_for_uid(uid_t uid, char *buffer, size_t buflen) {
     if (getpwuid_r(uid, &pwd, pwbuf, sizeof(pwbuf), &result) == 0 && result) {
         strncpy(buffer, result->pw_name, buflen - 1);
         buffer[buflen - 1] = '\0';
-        return;
+        return true;
     }
     snprintf(buffer, buflen, "%d", uid);
+    return false;
+}
+
+static size_t uid_slot(uid_t uid, size_t capacity) {
+    unsigned long long h = (unsigned long long)uid * 11400714819323198485ull;
+    return (size_t)(h >> 32) & (capacity - 1);
+}
+
+static void user_cache_flush(uid_name_cache *users, intern_pool *strings) {
+    for (size_t i = 0; i < users->capacity; ++i) {
+        if (users->entries[i].used)
+            intern_release(strings, users->entries[i].name);
+    }
+    if (users->entries)
+        memset(users->entries, 0, users->capacity * sizeof(uid_name_entry));
+    users->count = 0;
+}
+
+/* Drops every cached name once per refresh if /etc/passwd was modified. */
+static bool user_cache_validate(uid_name_cache *users, intern_pool *strings) {
+    struct stat st;
+    if (stat("/etc/passwd", &st) != 0)
+        return false;
+    if (st.st_mtim.tv_sec == users->passwd_mtime.tv_sec &&
+        st.st_mtim.tv_nsec == users->passwd_mtime.tv_nsec)
+        return false;
+    users->passwd_mtime = st.st_mtim;
+    user_cache_flush(users, strings);
+    return true;
+}
+
+static int user_cache_grow(uid_name_cache *users) {
+    size_t new_cap = users->capacity ? users->capacity * 2 : 64;
+    uid_name_entry *entries = calloc(new_cap, sizeof(uid_name_entry));
+    if (!entries)
+        return -1;
+    for (size_t i = 0; i < users->capacity; ++i) {
+        if (!users->entries[i].used)
+            continue;
+        size_t j = uid_slot(users->entries[i].uid, new_cap);
+        while (entries[j].used)
+            j = (j + 1) & (new_cap - 1);
+        entries[j] = users->entries[i];
+    }
+    free(users->entries);
+    users->entries = entries;
+    users->capacity = new_cap;
+    return 0;
+}
+
+/* Resolves uid through NSS at most once per /etc/passwd version. Unknown
+ * uids are cached too, so a uid missing from LDAP does not hit the
+ * directory again on every refresh. */
+static intern_id user_cache_name(uid_name_cache *users, intern_pool *strings, uid_t uid) {
+    if (users->capacity > 0) {
+        size_t mask = users->capacity - 1;
+        for (size_t i = uid_slot(uid, users->capacity); users->entries[i].used; i = (i + 1) & mask) {
+            if (users->entries[i].uid == uid)
+                return users->entries[i].name;
+        }
+    }
+
+    char buffer[64];
+    bool found = username_for_uid(uid, buffer, sizeof(buffer));
+    intern_id name;
+    if (intern_acquire(strings, buffer, &name) != 0)
+        return 0;
+    if ((users->count + 1) * 2 > users->capacity && user_cache_grow(users) != 0) {
+        intern_release(strings, name);
+        return 0;
+    }
+    size_t mask = users->capacity - 1;
+    size_t i = uid_slot(uid, users->capacity);
+    while (users->entries[i].used)
+        i = (i + 1) & mask;
+    uid_name_entry *entry = &users->entries[i];
+    entry->uid = uid;
+    entry->used = true;
+    entry->found = found;
+    entry->name = name;
+    users->count++;
+    return name;
 }
 
-static void load_cmdline(pid_t pid, const char *fallback, char *buffer, size_t buflen) {
+static void load_cmdline(pid_t pid, int *fd, const char *fallback, char *buffer, size_t buflen) {
     if (!buffer || buflen == 0)
         return;
     buffer[0] = '\0';
 
-    char path[64];
-    snprintf(path, sizeof(path), "/proc/%d/cmdline", pid);
-    FILE *fp = fopen(path, "r");
-    if (!fp) {
+    char raw[256];
+    ssize_t n = read_proc_file(pid, PROC_FILE_CMDLINE, fd, raw, sizeof(raw));
+    if (n < 0) {
         if (fallback) {
             strncpy(buffer, fallback, buflen - 1);
             buffer[buflen - 1] = '\0';
@@ -175,18 +764,16 @@ static void load_cmdline(pid_t pid, const char *fallback, char *buffer, size_t b
     }
 
     size_t written = 0;
-    int c;
-    while ((c = fgetc(fp)) != EOF && written < buflen - 1) {
-        if (c == '\0') {
+    for (ssize_t i = 0; i < n && written < buflen - 1; ++i) {
+        if (raw[i] == '\0') {
             if (written == 0)
                 continue;
             buffer[written++] = ' ';
         } else {
-            buffer[written++] = (char)c;
+            buffer[written++] = raw[i];
         }
     }
     buffer[written] = '\0';
-    fclose(fp);
 
     if (written == 0 && fallback) {
         strncpy(buffer, fallback, buflen - 1);
@@ -209,226 +796,1320 @@ static long read_mem_total_kb(void) {
     return value;
 }
 
-static int read_process_stat(pid_t pid, process_info *info, unsigned long long *total_ticks) {
-    if (!info || !total_ticks)
+static int read_process_stat(pid_t pid,
+                             int *fd,
+                             process_info *info,
+                             unsigned long long *total_ticks,
+                             unsigned long long *starttime) {
+    if (!info || !total_ticks || !starttime)
         return -1;
 
-    char path[64];
-    snprintf(path, sizeof(path), "/proc/%d/stat", pid);
-    FILE *fp = fopen(path, "r");
-    if (!fp)
+    char line[2048];
+    ssize_t len = read_proc_file(pid, PROC_FILE_STAT, fd, line, sizeof(line));
+    if (len <= 0)
         return -1;
 
-    char *line = NULL;
-    size_t len = 0;
-    ssize_t read = getline(&line, &len, fp);
-    fclose(fp);
-    if (read == -1) {
-        free(line);
+    proc_stat_fields stat;
+    if (procfs_parse_stat(line, (size_t)len, &stat) != 0)
         return -1;
+
+    info->pid = stat.pid;
+    size_t comm_len = stat.comm_len;
+    if (comm_len >= sizeof(info->command))
+        comm_len = sizeof(info->command) - 1;
+    memcpy(info->command, stat.comm, comm_len);
+    info->command[comm_len] = '\0';
+
+    info->ppid = stat.ppid;
+    info->state = stat.state;
+    info->vms_kb = (long)(stat.vsize / 1024);
+    info->rss_kb = (long)(stat.rss * g_page_size_kb);
+    info->threads = (int)stat.num_threads; /* status refines it when read */
+
+    *total_ticks = stat.utime + stat.stime;
+    *starttime = stat.starttime;
+    return 0;
+}
+
+/* Fills the status-backed fields (effective uid, threads, swap, context
+ * switches, namespace pid) from one read of /proc/<pid>/status. The user
+ * name is resolved during the merge phase so that sampling threads never
+ * go through NSS. */
+static void read_process_status(pid_t pid, int *fd, process_info *info) {
+    if (!info)
+        return;
+
+    char buffer[8192];
+    proc_status_fields status;
+    ssize_t len = read_proc_file(pid, PROC_FILE_STATUS, fd, buffer, sizeof(buffer));
+    if (len <= 0 || procfs_parse_status(buffer, (size_t)len, &status) != 0 ||
+        !(status.present & PROC_STATUS_HAS_UID)) {
+        /* "?" also tells the filter that the status fields are unknown */
+        info->uid = 0;
+        strcpy(info->user, "?");
+        return;
     }
 
-    char *ptr = line;
-    errno = 0;
-    long parsed_pid = strtol(ptr, &ptr, 10);
-    if (errno != 0) {
-        free(line);
+    info->uid = (uid_t)status.euid;
+    info->threads = status.threads >= 0 ? status.threads : 0;
+    info->swap_kb = status.vm_swap_kb;
+    info->nspid = (status.present & PROC_STATUS_HAS_NSPID) ? status.nspid : info->pid;
+    info->ctxt_voluntary = status.voluntary_ctxt_switches;
+    info->ctxt_involuntary = status.nonvoluntary_ctxt_switches;
+}
+
+static double monotonic_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+/* Reads /proc/<pid>/smaps_rollup. The kernel walks every VMA to produce
+ * it, so it is never kept open or read for every process in one refresh.
+ * Processes without an address space (kernel threads) read as empty and
+ * yield zeros. On failure errno tells a denied read from an exited one. */
+static int read_smaps_rollup(pid_t pid, proc_smaps_fields *out) {
+    char path[64];
+    snprintf(path, sizeof(path), "/proc/%d/smaps_rollup", pid);
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return -1;
+    char buffer[4096];
+    ssize_t n = pread(fd, buffer, sizeof(buffer) - 1, 0);
+    int saved = errno;
+    close(fd);
+    if (n < 0) {
+        errno = saved;
         return -1;
     }
-    info->pid = (pid_t)parsed_pid;
+    buffer[n] = '\0';
+    if (n == 0) {
+        memset(out, 0, sizeof(*out));
+        return 0;
+    }
+    return procfs_parse_smaps_rollup(buffer, (size_t)n, out);
+}
 
-    while (*ptr == ' ')
-        ptr++;
-    if (*ptr != '(') {
-        free(line);
-        return -1;
+/* The first row whose PID is above pid, or list->rows. Finished passes
+ * leave the rows in PID order (see sort_rows_by_pid()). */
+static size_t first_row_after(const process_list *list, pid_t pid) {
+    size_t lo = 0;
+    size_t hi = list->rows;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (list->pid[mid] <= pid)
+            lo = mid + 1;
+        else
+            hi = mid;
     }
-    ptr++;
-    char *comm_end = strrchr(ptr, ')');
-    if (!comm_end) {
-        free(line);
-        return -1;
+    return lo;
+}
+
+/* Reads smaps_rollup for listed processes round-robin, starting after the
+ * PID the previous pass stopped at, until budget_ms is spent. That PID may
+ * have exited since; the round continues with the next PID up either way.
+ * At least one process is read per pass so every row is eventually
+ * refreshed; the others keep their cached totals and report how old they
+ * are. */
+static void sample_smaps(process_list *list, process_cache *cache, int budget_ms) {
+    if (list->rows == 0)
+        return;
+    double start = monotonic_seconds();
+    double deadline = start + (double)budget_ms / 1000.0;
+    size_t first = first_row_after(list, cache->smaps_cursor);
+    for (size_t n = 0; n < list->rows; ++n) {
+        size_t row = (first + n) % list->rows;
+        proc_cpu_entry *entry = cache_find(cache, list->pid[row]);
+        if (!entry || entry->smaps_denied || list->detail[row].generation == 0)
+            continue;
+        proc_smaps_fields smaps;
+        if (read_smaps_rollup(list->pid[row], &smaps) != 0) {
+            if (errno == EACCES || errno == EPERM)
+                entry->smaps_denied = true;
+        } else {
+            double now = monotonic_seconds();
+            entry->pss_kb = smaps.pss_kb;
+            entry->uss_kb = smaps.private_clean_kb + smaps.private_dirty_kb;
+            entry->swap_pss_kb = smaps.swap_pss_kb;
+            entry->smaps_time = now;
+            process_detail *detail = &list->detail[row];
+            detail->pss_kb = entry->pss_kb;
+            detail->uss_kb = entry->uss_kb;
+            detail->swap_pss_kb = entry->swap_pss_kb;
+            detail->smaps_age = 0.0;
+        }
+        cache->smaps_cursor = list->pid[row];
+        if (monotonic_seconds() >= deadline)
+            break;
     }
-    size_t comm_len = comm_end - ptr;
-    if (comm_len >= sizeof(info->command))
-        comm_len = sizeof(info->command) - 1;
-    memcpy(info->command, ptr, comm_len);
-    info->command[comm_len] = '\0';
+}
 
-    ptr = comm_end + 2; // skip ") "
+/* Reads the storage I/O counters. Only the owner (or a tracer) may read
+ * another process's io file, so a refusal is recorded for the merge to
+ * remember instead of being retried every refresh. */
+static void read_process_io(pid_t pid, int *fd, proc_sample *sample) {
+    char buffer[1024];
+    ssize_t len = read_proc_file(pid, PROC_FILE_IO, fd, buffer, sizeof(buffer));
+    if (len < 0) {
+        sample->io_denied = errno == EACCES || errno == EPERM;
+        return;
+    }
+    sample->io_valid = procfs_parse_io(buffer, (size_t)len, &sample->io) == 0;
+}
 
-    unsigned long long utime = 0;
-    unsigned long long stime = 0;
-    unsigned long long vsize = 0;
-    long long rss = 0;
-    pid_t ppid = 0;
-    char state = '?';
+/* Threads a process may start between two reads and still have their
+ * descriptors kept. */
+#define TASK_FD_HEADROOM 4
 
-    int field_index = 3;
-    char *saveptr = NULL;
-    char *token = strtok_r(ptr, " ", &saveptr);
-    while (token) {
-        switch (field_index) {
-            case 3:
-                state = token[0];
-                break;
-            case 4:
-                ppid = (pid_t)strtol(token, NULL, 10);
-                break;
-            case 14:
-                utime = strtoull(token, NULL, 10);
-                break;
-            case 15:
-                stime = strtoull(token, NULL, 10);
-                break;
-            case 23:
-                vsize = strtoull(token, NULL, 10);
-                break;
-            case 24:
-                rss = strtoll(token, NULL, 10);
-                break;
-            default:
-                break;
-        }
-        token = strtok_r(NULL, " ", &saveptr);
-        field_index++;
-    }
-
-    info->ppid = ppid;
-    info->state = state;
-    info->vms_kb = (long)(vsize / 1024);
-    info->rss_kb = (long)(rss * g_page_size_kb);
-
-    *total_ticks = utime + stime;
-
-    free(line);
+static int ensure_task_capacity(proc_sample *sample, size_t needed) {
+    if (sample->task_capacity >= needed)
+        return 0;
+    size_t new_cap = sample->task_capacity ? sample->task_capacity * 2 : 16;
+    while (new_cap < needed)
+        new_cap *= 2;
+    proc_task_sched *tasks = realloc(sample->tasks, new_cap * sizeof(proc_task_sched));
+    if (!tasks)
+        return -1;
+    sample->tasks = tasks;
+    sample->task_capacity = new_cap;
     return 0;
 }
 
-static void populate_user_info(pid_t pid, process_info *info) {
+static int task_tid_cmp(const void *lhs, const void *rhs) {
+    pid_t a = ((const proc_task_sched *)lhs)->tid;
+    pid_t b = ((const proc_task_sched *)rhs)->tid;
+    return (a > b) - (a < b);
+}
+
+static proc_task_sched *find_task(const proc_task_sched *tasks, size_t count, pid_t tid) {
+    proc_task_sched key = {tid, -1, 0, 0};
+    return tasks ? bsearch(&key, tasks, count, sizeof(*tasks), task_tid_cmp) : NULL;
+}
+
+/* Reads task/<tid>/schedstat into task, through task->fd when it is open.
+ * *spare is how many more descriptors may be kept: a new one is kept while
+ * it is positive, an open one is closed while it is negative. -1 when the
+ * thread is gone, with its descriptor closed. */
+static int read_task_schedstat(pid_t pid, proc_task_sched *task, int *spare) {
     char path[64];
-    snprintf(path, sizeof(path), "/proc/%d", pid);
-    struct stat st;
-    if (stat(path, &st) == -1) {
-        info->uid = 0;
-        strcpy(info->user, "?");
+    snprintf(path, sizeof(path), "/proc/%d/task/%d/schedstat", pid, task->tid);
+    if (task->fd >= 0 && *spare < 0) {
+        close(task->fd);
+        task->fd = -1;
+        (*spare)++;
+    }
+    bool keep = task->fd >= 0;
+    if (!keep) {
+        task->fd = open(path, O_RDONLY | O_CLOEXEC);
+        if (task->fd < 0)
+            return -1;
+        keep = *spare > 0;
+        if (keep)
+            (*spare)--;
+    }
+
+    char buffer[128];
+    ssize_t len = pread(task->fd, buffer, sizeof(buffer) - 1, 0);
+    if (len <= 0 || !keep) {
+        close(task->fd);
+        task->fd = -1;
+        if (keep)
+            (*spare)++;
+        keep = false;
+    }
+    proc_schedstat_fields fields;
+    if (len <= 0 || procfs_parse_schedstat(buffer, (size_t)len, &fields) != 0)
+        return -1;
+    task->cpu_ns = fields.cpu_ns;
+    task->runq_ns = fields.runq_ns;
+    return 0;
+}
+
+/* Adds the threads in /proc/<pid>/task that sample->tasks does not hold
+ * yet. The ones it holds were read already during this refresh. */
+static int list_new_tasks(pid_t pid, proc_sample *sample, int *spare) {
+    char path[64];
+    snprintf(path, sizeof(path), "/proc/%d/task", pid);
+    DIR *dir = opendir(path);
+    if (!dir)
+        return -1;
+    size_t read_before = sample->task_count;
+    int result = 0;
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL) {
+        if (entry->d_name[0] < '0' || entry->d_name[0] > '9')
+            continue;
+        pid_t tid = (pid_t)strtol(entry->d_name, NULL, 10);
+        if (find_task(sample->tasks, read_before, tid))
+            continue;
+        if (ensure_task_capacity(sample, sample->task_count + 1) != 0) {
+            result = -1;
+            break;
+        }
+        proc_task_sched *task = &sample->tasks[sample->task_count];
+        *task = (proc_task_sched){tid, -1, 0, 0};
+        if (read_task_schedstat(pid, task, spare) == 0)
+            sample->task_count++;
+    }
+    closedir(dir);
+    qsort(sample->tasks, sample->task_count, sizeof(*sample->tasks), task_tid_cmp);
+    return result;
+}
+
+/* Reads the schedstat files of every thread. Each read is compared with
+ * the same thread's previous one and the process's counters advance by the
+ * sum, so the time of a thread that exits simply stops adding up. The
+ * threads of the last read are read again by their descriptors or paths;
+ * the task directory is only listed when their number no longer matches
+ * the thread count from stat. */
+static void read_process_tasks(pid_t pid, int threads, const proc_cpu_entry *known,
+                               proc_sample *sample) {
+    /* the last read's threads, or just the main thread when the process
+     * was single-threaded then: its file gave the process's counters */
+    const proc_task_sched *prev = NULL;
+    size_t prev_count = 0;
+    proc_task_sched main_thread;
+    if (known && known->task_count > 0) {
+        prev = known->tasks;
+        prev_count = known->task_count;
+    } else if (known && known->sched_valid) {
+        main_thread = (proc_task_sched){pid, -1, known->sched_cpu_ns, known->sched_runq_ns};
+        prev = &main_thread;
+        prev_count = 1;
+    }
+
+    if (ensure_task_capacity(sample, known ? known->task_count : 0) != 0)
+        return;
+    sample->tasks_read = true;
+    if (known && known->task_count > 0) {
+        memcpy(sample->tasks, known->tasks, known->task_count * sizeof(*sample->tasks));
+        sample->task_count = known->task_count;
+        sample->tasks_taken = true;
+    }
+    int spare = sample->task_fd_limit - (int)count_task_fds(sample->tasks, sample->task_count);
+
+    /* threads that are gone drop out; only a count that stat does not
+     * confirm makes the directory worth listing */
+    size_t alive = 0;
+    for (size_t i = 0; i < sample->task_count; ++i) {
+        if (read_task_schedstat(pid, &sample->tasks[i], &spare) == 0)
+            sample->tasks[alive++] = sample->tasks[i];
+    }
+    sample->task_count = alive;
+    if (alive != (size_t)threads && list_new_tasks(pid, sample, &spare) != 0) {
+        close_task_fds(sample->tasks, sample->task_count);
+        sample->task_count = 0;
         return;
     }
-    info->uid = st.st_uid;
-    username_for_uid(info->uid, info->user, sizeof(info->user));
+
+    /* without a baseline there is nothing to advance: start from the sum;
+     * timeslices are not kept per thread */
+    bool advance = known && known->sched_valid;
+    proc_schedstat_fields total = {0, 0, 0};
+    if (advance) {
+        total.cpu_ns = known->sched_cpu_ns;
+        total.runq_ns = known->sched_runq_ns;
+    }
+    for (size_t i = 0; i < sample->task_count; ++i) {
+        const proc_task_sched *task = &sample->tasks[i];
+        const proc_task_sched *was = advance ? find_task(prev, prev_count, task->tid) : NULL;
+        unsigned long long cpu_ns = task->cpu_ns;
+        unsigned long long runq_ns = task->runq_ns;
+        if (was) {
+            cpu_ns = cpu_ns > was->cpu_ns ? cpu_ns - was->cpu_ns : 0;
+            runq_ns = runq_ns > was->runq_ns ? runq_ns - was->runq_ns : 0;
+        }
+        total.cpu_ns += cpu_ns;
+        total.runq_ns += runq_ns;
+    }
+    sample->sched = total;
+    sample->sched_valid = sample->task_count > 0;
 }
 
-static void populate_thread_count(pid_t pid, process_info *info) {
-    if (!info)
+/* Reads on-CPU and run-queue nanoseconds. /proc/<pid>/schedstat only
+ * describes the main thread, so once a process has more than one thread
+ * its counters come from read_process_tasks() instead. known is the cache
+ * entry of this same process, if any. */
+static void read_process_schedstat(pid_t pid, int *fd, int threads, const proc_cpu_entry *known,
+                                   proc_sample *sample) {
+    if (threads > 1 || (known && known->task_count > 0)) {
+        read_process_tasks(pid, threads, known, sample);
         return;
-    info->threads = 0;
+    }
+    char buffer[128];
+    ssize_t len = read_proc_file(pid, PROC_FILE_SCHEDSTAT, fd, buffer, sizeof(buffer));
+    sample->sched_valid =
+        len > 0 && procfs_parse_schedstat(buffer, (size_t)len, &sample->sched) == 0;
+}
 
-    char path[64];
-    snprintf(path, sizeof(path), "/proc/%d/status", pid);
-    FILE *fp = fopen(path, "r");
-    if (!fp)
+/* Per-key comparators over row indices, resolved once per refresh and
+ * handed the list through qsort_r's context. Equal keys fall back to the
+ * row index so the order is total and rows keep their place between
+ * refreshes: rows are listed in PID order (only the processes found by an
+ * unfinished incremental pass sit after them), so that is ascending PID
+ * without loading the PIDs. Nothing global is read, so they are safe from
+ * any thread. */
+#define ROW_CMP(x, y) (((x) > (y)) - ((x) < (y)))
+
+static int pid_cmp(const process_list *list, size_t a, size_t b) {
+    return ROW_CMP(list->pid[a], list->pid[b]);
+}
+
+/* Defines NAME_asc/NAME_desc; KEY(list, a, b) orders row a first when negative. */
+#define DEFINE_COMPARATORS(name, KEY)                                    \
+    static int name##_asc(const void *lhs, const void *rhs, void *ctx) { \
+        const process_list *list = ctx;                                  \
+        size_t a = *(const size_t *)lhs;                                 \
+        size_t b = *(const size_t *)rhs;                                 \
+        int result = KEY(list, a, b);                                    \
+        return result ? result : ROW_CMP(a, b);                          \
+    }                                                                    \
+    static int name##_desc(const void *lhs, const void *rhs, void *ctx) { \
+        const process_list *list = ctx;                                  \
+        size_t a = *(const size_t *)lhs;                                 \
+        size_t b = *(const size_t *)rhs;                                 \
+        int result = KEY(list, b, a);                                    \
+        return result ? result : ROW_CMP(a, b);                          \
+    }
+
+#define CPU_KEY(l, a, b) ROW_CMP((l)->cpu_percent[a], (l)->cpu_percent[b])
+#define MEM_KEY(l, a, b) ROW_CMP((l)->mem_percent[a], (l)->mem_percent[b])
+#define RSS_KEY(l, a, b) ROW_CMP((l)->rss_kb[a], (l)->rss_kb[b])
+#define THREADS_KEY(l, a, b) ROW_CMP((l)->detail[a].threads, (l)->detail[b].threads)
+#define TIME_KEY(l, a, b) ROW_CMP((l)->detail[a].cpu_time, (l)->detail[b].cpu_time)
+#define PSS_KEY(l, a, b) ROW_CMP((l)->detail[a].pss_kb, (l)->detail[b].pss_kb)
+#define IO_READ_KEY(l, a, b) ROW_CMP((l)->detail[a].io_read_rate, (l)->detail[b].io_read_rate)
+#define IO_WRITE_KEY(l, a, b) ROW_CMP((l)->detail[a].io_write_rate, (l)->detail[b].io_write_rate)
+#define IO_CANCELLED_KEY(l, a, b) \
+    ROW_CMP((l)->detail[a].io_cancelled_rate, (l)->detail[b].io_cancelled_rate)
+#define RUNQ_KEY(l, a, b) ROW_CMP((l)->detail[a].runq_percent, (l)->detail[b].runq_percent)
+#define NAME_KEY(l, a, b) intern_compare((l)->strings, (l)->detail[a].command, (l)->detail[b].command)
+
+DEFINE_COMPARATORS(cpu, CPU_KEY)
+DEFINE_COMPARATORS(mem, MEM_KEY)
+DEFINE_COMPARATORS(rss, RSS_KEY)
+DEFINE_COMPARATORS(threads, THREADS_KEY)
+DEFINE_COMPARATORS(time, TIME_KEY)
+DEFINE_COMPARATORS(pss, PSS_KEY)
+DEFINE_COMPARATORS(io_read, IO_READ_KEY)
+DEFINE_COMPARATORS(io_write, IO_WRITE_KEY)
+DEFINE_COMPARATORS(io_cancelled, IO_CANCELLED_KEY)
+DEFINE_COMPARATORS(runq, RUNQ_KEY)
+DEFINE_COMPARATORS(name, NAME_KEY)
+static int pid_asc(const void *lhs, const void *rhs, void *ctx) {
+    return pid_cmp(ctx, *(const size_t *)lhs, *(const size_t *)rhs);
+}
+
+static int pid_desc(const void *lhs, const void *rhs, void *ctx) {
+    return pid_cmp(ctx, *(const size_t *)rhs, *(const size_t *)lhs);
+}
+
+/* [key][reverse]: counts and sizes sort largest first, pid and name
+ * smallest first. */
+static const process_comparator comparators[SORT_KEY_COUNT][2] = {
+    [SORT_KEY_CPU] = {cpu_desc, cpu_asc},
+    [SORT_KEY_MEM] = {mem_desc, mem_asc},
+    [SORT_KEY_PID] = {pid_asc, pid_desc},
+    [SORT_KEY_NAME] = {name_asc, name_desc},
+    [SORT_KEY_RSS] = {rss_desc, rss_asc},
+    [SORT_KEY_THREADS] = {threads_desc, threads_asc},
+    [SORT_KEY_TIME] = {time_desc, time_asc},
+    [SORT_KEY_PSS] = {pss_desc, pss_asc},
+    [SORT_KEY_IO_READ] = {io_read_desc, io_read_asc},
+    [SORT_KEY_IO_WRITE] = {io_write_desc, io_write_asc},
+    [SORT_KEY_IO_CANCELLED] = {io_cancelled_desc, io_cancelled_asc},
+    [SORT_KEY_RUNQ] = {runq_desc, runq_asc},
+};
+
+process_comparator process_list_comparator(const cupid_config *config) {
+    sort_key_t key = config->sort_key;
+    if ((unsigned int)key >= SORT_KEY_COUNT)
+        key = SORT_KEY_CPU;
+    return comparators[key][config->sort_reverse ? 1 : 0];
+}
+
+static void swap_rows(size_t *a, size_t *b) {
+    size_t tmp = *a;
+    *a = *b;
+    *b = tmp;
+}
+
+/* nth_element: moves the k rows that sort first into [0, k), in no
+ * particular order. Three-way partitioning keeps the many equal keys
+ * (idle processes at 0.0% CPU) from degrading it to quadratic time. */
+static void select_first(size_t *rows, size_t n, size_t k, process_comparator cmp, void *ctx) {
+    size_t lo = 0;
+    size_t hi = n;
+    int depth = 64;
+    while (k > lo && k < hi && hi - lo > 1) {
+        if (--depth == 0) {
+            qsort_r(rows + lo, hi - lo, sizeof(*rows), cmp, ctx);
+            return;
+        }
+        /* median of three */
+        size_t mid = lo + (hi - lo) / 2;
+        if (cmp(&rows[mid], &rows[lo], ctx) < 0)
+            swap_rows(&rows[mid], &rows[lo]);
+        if (cmp(&rows[hi - 1], &rows[lo], ctx) < 0)
+            swap_rows(&rows[hi - 1], &rows[lo]);
+        if (cmp(&rows[hi - 1], &rows[mid], ctx) < 0)
+            swap_rows(&rows[hi - 1], &rows[mid]);
+        size_t pivot = rows[mid];
+
+        /* [lo, lt) < pivot, [lt, i) == pivot, [gt, hi) > pivot */
+        size_t lt = lo;
+        size_t i = lo;
+        size_t gt = hi;
+        while (i < gt) {
+            int c = cmp(&rows[i], &pivot, ctx);
+            if (c < 0)
+                swap_rows(&rows[lt++], &rows[i++]);
+            else if (c > 0)
+                swap_rows(&rows[i], &rows[--gt]);
+            else
+                i++;
+        }
+        if (k <= lt)
+            hi = lt;
+        else if (k <= gt)
+            return;
+        else
+            lo = gt;
+    }
+}
+
+void process_cache_set_visible_rows(process_cache *cache, size_t rows) {
+    if (cache)
+        cache->visible_rows = rows;
+}
+
+void process_cache_set_background(process_cache *cache, bool background) {
+    if (!cache || cache->background == background)
         return;
+    cache->background = background;
+    cache->mask_valid = false; /* takes effect with the next pass */
+}
 
-    char line[256];
-    while (fgets(line, sizeof(line), fp)) {
-        if (strncmp(line, "Threads:", 8) == 0) {
-            int t = 0;
-            if (sscanf(line + 8, "%d", &t) == 1 && t >= 0) {
-                info->threads = t;
-            }
+void process_list_ensure_sorted(process_list *list, const struct cupid_config *config, size_t rows) {
+    if (!list || !config || rows <= list->sorted || list->sorted >= list->count)
+        return;
+    /* Everything past sorted already compares after it. Handed over in row
+     * order, rows with equal keys (the idle ones, mostly) already stand in
+     * tie-break order, which spares qsort_r about 40% of its comparisons.
+     * first_child is scratch until link_children(). */
+    size_t *taken = list->first_child;
+    for (size_t row = 0; row < list->rows; ++row)
+        taken[row] = 0;
+    for (size_t pos = 0; pos < list->sorted; ++pos)
+        taken[list->order[pos]] = 1;
+    for (size_t pos = list->count; pos < list->rows; ++pos)
+        taken[list->order[pos]] = 1;
+    size_t pos = list->sorted;
+    for (size_t row = 0; row < list->rows; ++row) {
+        if (!taken[row])
+            list->order[pos++] = row;
+    }
+    qsort_r(list->order + list->sorted, list->count - list->sorted, sizeof(*list->order),
+            process_list_comparator(config), list);
+    list->sorted = list->count;
+    link_children(list);
+}
+
+/* Per-second rate of a cumulative counter; a counter that went backwards
+ * counts as idle. */
+static double counter_rate(unsigned long long prev, unsigned long long cur, double seconds) {
+    if (cur < prev || seconds <= 0.0)
+        return 0.0;
+    return (double)(cur - prev) / seconds;
+}
+
+static int ensure_sample_capacity(process_cache *cache, size_t needed) {
+    if (cache->sample_capacity >= needed)
+        return 0;
+    size_t new_cap = cache->sample_capacity ? cache->sample_capacity * 2 : 256;
+    while (new_cap < needed)
+        new_cap *= 2;
+    proc_sample *samples = realloc(cache->samples, new_cap * sizeof(proc_sample));
+    if (!samples)
+        return -1;
+    for (size_t i = cache->sample_capacity; i < new_cap; ++i) {
+        samples[i].tasks = NULL;
+        samples[i].task_count = 0;
+        samples[i].task_capacity = 0;
+    }
+    cache->samples = samples;
+    cache->sample_capacity = new_cap;
+    return 0;
+}
+
+/* Reads everything cuPID needs about one PID. Runs on scan workers, so it
+ * must only read shared state: the cache is not modified until the merge. */
+static void sample_process(const process_cache *cache, proc_sample *sample) {
+    pid_t pid = sample->pid;
+    process_info *info = &sample->info;
+    memset(info, 0, sizeof(*info));
+    for (int f = 0; f < PROC_FILE_COUNT; ++f)
+        sample->fds[f] = -1;
+    if (sample->fd_slot >= 0)
+        memcpy(sample->fds, cache->fd_slots[sample->fd_slot].fds, sizeof(sample->fds));
+    int *fds = cache->fd_slot_count > 0 ? sample->fds : NULL;
+
+    sample->command_cached = false;
+    sample->filtered = false;
+    sample->io_valid = false;
+    sample->io_denied = false;
+    sample->sched_valid = false;
+    sample->tasks_read = false;
+    sample->tasks_taken = false;
+    sample->task_count = 0;
+    sample->valid = read_process_stat(pid, fds ? &fds[PROC_FILE_STAT] : NULL, info,
+                                      &sample->total_ticks, &sample->starttime) == 0;
+    if (!sample->valid)
+        return;
+    /* the entry only describes this process if starttime matches */
+    const proc_cpu_entry *known = sample->known;
+    if (known && known->starttime != sample->starttime)
+        known = NULL;
+    /* read next to stat, before the filter, so that both CPU baselines
+     * survive a filtered refresh and share one timestamp */
+    if (cache->field_mask & PROC_FIELD_SCHEDSTAT)
+        read_process_schedstat(pid, fds ? &fds[PROC_FILE_SCHEDSTAT] : NULL, info->threads, known,
+                               sample);
+    /* the moment total_ticks was true, which for the last PIDs of a long
+     * scan is well after the refresh started */
+    sample->sampled_at = monotonic_seconds();
+    /* info->command holds comm until the cmdline replaces it */
+    size_t comm_len = strnlen(info->command, sizeof(sample->comm) - 1);
+    memcpy(sample->comm, info->command, comm_len);
+    sample->comm[comm_len] = '\0';
+
+    /* Rejecting a process as soon as the fields read so far decide it
+     * saves the status and cmdline reads for everything filtered out. */
+    filter_subject subject = {info, sample->comm, NULL, NULL, false};
+    info->cpu_time = (double)sample->total_ticks / (double)g_ticks_per_sec;
+    if (cache->filter && filter_eval(cache->filter, &subject, FILTER_STAGE_STAT) == FILTER_FALSE) {
+        sample->filtered = true;
+        return;
+    }
+
+    unsigned int fields = cache->field_mask;
+    if (fields & PROC_FIELD_STATUS) {
+        read_process_status(pid, fds ? &fds[PROC_FILE_STATUS] : NULL, info);
+        subject.status_unknown = info->user[0] != '\0';
+        if (cache->filter && filter_eval(cache->filter, &subject,
+                                         FILTER_STAGE_STAT | FILTER_STAGE_STATUS) == FILTER_FALSE) {
+            sample->filtered = true;
+            return;
+        }
+    }
+
+    bool io_denied = known && known->io_denied;
+    if ((fields & PROC_FIELD_IO) && !io_denied)
+        read_process_io(pid, fds ? &fds[PROC_FILE_IO] : NULL, sample);
+
+    /* A command line only changes on exec, which usually also changes comm,
+     * so the cached command stays valid for the same process while comm is
+     * unchanged. With proc_events, exec events clear comm as well. */
+    bool want_cmdline = (fields & PROC_FIELD_CMDLINE) != 0;
+    bool full_ok = known && (known->command_full == want_cmdline ||
+                             (cache->background && known->command_full));
+    if (full_ok && known->command != 0 && strcmp(known->comm, sample->comm) == 0) {
+        sample->command_cached = true;
+        return;
+    }
+    if (!want_cmdline)
+        return;
+    load_cmdline(pid, fds ? &fds[PROC_FILE_CMDLINE] : NULL, sample->comm,
+                 info->command, sizeof(info->command));
+}
+
+#define SCAN_CHUNK 64
+
+struct scan_pool {
+    pthread_t *threads;
+    int thread_count; /* helper threads; the refreshing thread works too */
+    pthread_mutex_t lock;
+    pthread_cond_t wake;
+    pthread_cond_t idle;
+    unsigned int round;
+    int busy;
+    bool stop;
+    const process_cache *cache;
+    atomic_size_t next; /* first sample of the next unclaimed chunk */
+    size_t end;         /* one past the last sample of this round */
+};
+
+static void scan_pool_drain(struct scan_pool *pool) {
+    const process_cache *cache = pool->cache;
+    size_t n = pool->end;
+    for (;;) {
+        size_t begin = atomic_fetch_add(&pool->next, SCAN_CHUNK);
+        if (begin >= n)
+            break;
+        size_t end = begin + SCAN_CHUNK < n ? begin + SCAN_CHUNK : n;
+        for (size_t i = begin; i < end; ++i)
+            sample_process(cache, &cache->samples[i]);
+    }
+}
+
+static void *scan_worker(void *arg) {
+    struct scan_pool *pool = arg;
+    unsigned int seen = 0;
+    pthread_mutex_lock(&pool->lock);
+    for (;;) {
+        while (!pool->stop && pool->round == seen)
+            pthread_cond_wait(&pool->wake, &pool->lock);
+        if (pool->stop)
+            break;
+        seen = pool->round;
+        pthread_mutex_unlock(&pool->lock);
+
+        scan_pool_drain(pool);
+
+        pthread_mutex_lock(&pool->lock);
+        if (--pool->busy == 0)
+            pthread_cond_signal(&pool->idle);
+    }
+    pthread_mutex_unlock(&pool->lock);
+    return NULL;
+}
+
+static void scan_pool_destroy(struct scan_pool *pool) {
+    if (!pool)
+        return;
+    pthread_mutex_lock(&pool->lock);
+    pool->stop = true;
+    pthread_cond_broadcast(&pool->wake);
+    pthread_mutex_unlock(&pool->lock);
+    for (int i = 0; i < pool->thread_count; ++i)
+        pthread_join(pool->threads[i], NULL);
+    pthread_mutex_destroy(&pool->lock);
+    pthread_cond_destroy(&pool->wake);
+    pthread_cond_destroy(&pool->idle);
+    free(pool->threads);
+    free(pool);
+}
+
+static struct scan_pool *scan_pool_create(int workers) {
+    struct scan_pool *pool = calloc(1, sizeof(*pool));
+    if (!pool)
+        return NULL;
+    pool->threads = calloc((size_t)(workers - 1), sizeof(pthread_t));
+    if (!pool->threads) {
+        free(pool);
+        return NULL;
+    }
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->wake, NULL);
+    pthread_cond_init(&pool->idle, NULL);
+    atomic_init(&pool->next, 0);
+    /* Workers inherit the mask, so terminal signals (SIGWINCH, SIGTSTP)
+     * and their ncurses handlers stay on the threads that expect them */
+    sigset_t all, saved;
+    sigfillset(&all);
+    pthread_sigmask(SIG_BLOCK, &all, &saved);
+    for (int i = 0; i < workers - 1; ++i) {
+        if (pthread_create(&pool->threads[i], NULL, scan_worker, pool) != 0)
             break;
+        pool->thread_count++;
+    }
+    pthread_sigmask(SIG_SETMASK, &saved, NULL);
+    return pool;
+}
+
+static void scan_pool_run(struct scan_pool *pool, const process_cache *cache, size_t begin,
+                          size_t end) {
+    pthread_mutex_lock(&pool->lock);
+    pool->cache = cache;
+    atomic_store(&pool->next, begin);
+    pool->end = end;
+    pool->busy = pool->thread_count;
+    pool->round++;
+    pthread_cond_broadcast(&pool->wake);
+    pthread_mutex_unlock(&pool->lock);
+
+    scan_pool_drain(pool);
+
+    pthread_mutex_lock(&pool->lock);
+    while (pool->busy > 0)
+        pthread_cond_wait(&pool->idle, &pool->lock);
+    pthread_mutex_unlock(&pool->lock);
+}
+
+static int scan_worker_count(const cupid_config *config) {
+    int workers = config->scan_threads > 0 ? config->scan_threads : g_cpu_count;
+    if (workers > 64)
+        workers = 64;
+    return workers;
+}
+
+static void sample_all(process_cache *cache, const cupid_config *config, size_t begin, size_t end) {
+    int workers = scan_worker_count(config);
+    if (cache->pool && cache->pool->thread_count != workers - 1) {
+        scan_pool_destroy(cache->pool);
+        cache->pool = NULL;
+    }
+    if (workers > 1 && !cache->pool)
+        cache->pool = scan_pool_create(workers);
+
+    if (cache->pool && end - begin > SCAN_CHUNK) {
+        scan_pool_run(cache->pool, cache, begin, end);
+        return;
+    }
+    for (size_t i = begin; i < end; ++i)
+        sample_process(cache, &cache->samples[i]);
+}
+
+/* Gives entry the threads its sample read, swapping buffers so the sample
+ * keeps the old one as scratch. A sample that read no threads leaves the
+ * entry without them: its counters are the main thread's again. */
+static void store_tasks(process_cache *cache, proc_cpu_entry *entry, proc_sample *sample) {
+    if (sample->tasks_taken)
+        cache->task_fds -= count_task_fds(entry->tasks, entry->task_count);
+    else
+        entry_task_fds_close(cache, entry);
+    if (!sample->tasks_read) {
+        entry->task_count = 0;
+        return;
+    }
+    proc_task_sched *tasks = entry->tasks;
+    size_t capacity = entry->task_capacity;
+    entry->tasks = sample->tasks;
+    entry->task_count = sample->task_count;
+    entry->task_capacity = sample->task_capacity;
+    cache->task_fds += count_task_fds(entry->tasks, entry->task_count);
+    sample->tasks = tasks;
+    sample->task_capacity = capacity;
+    sample->task_count = 0;
+    sample->tasks_read = false;
+    sample->tasks_taken = false;
+}
+
+/* Returns borrowed descriptors of samples that will not be merged. */
+static void discard_samples(process_cache *cache, size_t from) {
+    for (size_t i = from; i < cache->sample_count; ++i) {
+        proc_sample *sample = &cache->samples[i];
+        if (sample->fd_slot >= 0)
+            memcpy(cache->fd_slots[sample->fd_slot].fds, sample->fds, sizeof(sample->fds));
+        else
+            close_fds(sample->fds);
+        /* the threads' counters moved past the entry's baseline */
+        proc_cpu_entry *known = sample->tasks_taken ? cache_find(cache, sample->pid) : NULL;
+        if (known) {
+            store_tasks(cache, known, sample);
+            known->sched_valid = false;
+        } else {
+            close_task_fds(sample->tasks, sample->task_count);
+            sample->task_count = 0;
+            sample->tasks_read = false;
         }
     }
-    fclose(fp);
+    cache->sample_count = 0;
 }
 
-static int double_cmp(double a, double b) {
-    if (a < b)
+int process_cache_set_filter(process_cache *cache, const char *expr, char *err, size_t errlen) {
+    if (!cache)
         return -1;
-    if (a > b)
-        return 1;
+    if (err && errlen > 0)
+        err[0] = '\0';
+    process_filter *filter = NULL;
+    if (expr && expr[strspn(expr, " \t")] != '\0') {
+        filter = filter_compile(expr, err, errlen);
+        if (!filter)
+            return -1;
+    }
+    filter_free(cache->filter);
+    cache->filter = filter;
+    cache->mask_valid = false; /* the filter may need other /proc files */
+    /* The rest of an incremental pass would be sampled without them, and
+     * the filter would see NULL users and commands: start the pass over. */
+    if (cache->scan_active && (filter_fields(filter) & ~cache->field_mask)) {
+        discard_samples(cache, cache->scan_next);
+        cache->scan_active = false;
+    }
     return 0;
 }
 
-static const char *g_sort_key = "cpu";
-static bool g_sort_reverse = false;
+static const struct {
+    const char *name;
+    unsigned int fields;
+} column_fields[] = {
+    {"user", PROC_FIELD_USER | PROC_FIELD_STATUS},
+    {"threads", PROC_FIELD_STATUS},
+    {"swap", PROC_FIELD_STATUS},
+    {"vcsw", PROC_FIELD_STATUS},
+    {"nvcsw", PROC_FIELD_STATUS},
+    {"nspid", PROC_FIELD_STATUS},
+    {"command", PROC_FIELD_CMDLINE},
+    {"cpu_tree", PROC_FIELD_TREE},
+    {"rss_tree", PROC_FIELD_TREE},
+    {"threads_tree", PROC_FIELD_TREE | PROC_FIELD_STATUS},
+    {"pss", PROC_FIELD_SMAPS},
+    {"uss", PROC_FIELD_SMAPS},
+    {"swap_pss", PROC_FIELD_SMAPS},
+    {"smaps_age", PROC_FIELD_SMAPS},
+    {"io_read", PROC_FIELD_IO},
+    {"io_write", PROC_FIELD_IO},
+    {"io_cancelled", PROC_FIELD_IO},
+    {"runq", PROC_FIELD_SCHEDSTAT},
+};
+
+static unsigned int fields_for_column(const char *column) {
+    for (size_t i = 0; i < sizeof(column_fields) / sizeof(column_fields[0]); ++i) {
+        if (strcasecmp(column, column_fields[i].name) == 0)
+            return column_fields[i].fields;
+    }
+    return 0;
+}
 
-static int process_compare(const void *lhs, const void *rhs) {
-    const process_info *a = lhs;
-    const process_info *b = rhs;
-    int result = 0;
-    if (strcasecmp(g_sort_key, "cpu") == 0) {
-        result = double_cmp(b->cpu_percent, a->cpu_percent);
-    } else if (strcasecmp(g_sort_key, "memory") == 0 || strcasecmp(g_sort_key, "mem") == 0) {
-        result = double_cmp(b->mem_percent, a->mem_percent);
-    } else if (strcasecmp(g_sort_key, "pid") == 0) {
-        if (a->pid < b->pid)
-            result = -1;
-        else if (a->pid > b->pid)
-            result = 1;
-    } else if (strcasecmp(g_sort_key, "name") == 0 || strcasecmp(g_sort_key, "command") == 0) {
-        result = strcasecmp(a->command, b->command);
-    } else {
-        result = double_cmp(b->cpu_percent, a->cpu_percent);
+/* Compiles config->columns and the sort key into PROC_FIELD_* bits so a
+ * refresh skips /proc files and lookups nothing displays or sorts on.
+ * Recompiled only when either string changes. */
+static void update_field_mask(process_cache *cache, const cupid_config *config) {
+    if (cache->mask_valid && strcmp(cache->mask_columns, config->columns) == 0 &&
+        cache->mask_sort == (int)config->sort_key &&
+        cache->mask_cpu_schedstat == config->cpu_schedstat)
+        return;
+
+    unsigned int mask = 0;
+    char columns[sizeof(config->columns)];
+    snprintf(columns, sizeof(columns), "%s", config->columns);
+    int token_count = 0;
+    char *saveptr = NULL;
+    for (char *token = strtok_r(columns, ",", &saveptr); token;
+         token = strtok_r(NULL, ",", &saveptr)) {
+        while (*token == ' ' || *token == '\t')
+            token++;
+        size_t len = strlen(token);
+        while (len > 0 && (token[len - 1] == ' ' || token[len - 1] == '\t'))
+            token[--len] = '\0';
+        if (*token == '\0')
+            continue;
+        mask |= fields_for_column(token);
+        token_count++;
     }
+    /* the table falls back to pid,user,cpu,mem,command without columns */
+    if (token_count == 0)
+        mask |= fields_for_column("user") | fields_for_column("command");
+
+    if (config->sort_key == SORT_KEY_NAME)
+        mask |= PROC_FIELD_CMDLINE;
+    else if (config->sort_key == SORT_KEY_THREADS)
+        mask |= PROC_FIELD_STATUS;
+    else if (config->sort_key == SORT_KEY_PSS)
+        mask |= PROC_FIELD_SMAPS;
+    else if (config->sort_key == SORT_KEY_IO_READ || config->sort_key == SORT_KEY_IO_WRITE ||
+             config->sort_key == SORT_KEY_IO_CANCELLED)
+        mask |= PROC_FIELD_IO;
+    else if (config->sort_key == SORT_KEY_RUNQ)
+        mask |= PROC_FIELD_SCHEDSTAT;
+    if (config->cpu_schedstat)
+        mask |= PROC_FIELD_SCHED_CPU | PROC_FIELD_SCHEDSTAT;
+    /* out of focus the list is only glanced at: keep stat and status,
+     * which the other columns need, and whatever the filter tests */
+    if (cache->background)
+        mask &= ~(unsigned int)(PROC_FIELD_SMAPS | PROC_FIELD_IO | PROC_FIELD_SCHEDSTAT |
+                                PROC_FIELD_SCHED_CPU | PROC_FIELD_CMDLINE);
+    mask |= filter_fields(cache->filter);
+
+    cache->field_mask = mask;
+    snprintf(cache->mask_columns, sizeof(cache->mask_columns), "%s", config->columns);
+    cache->mask_sort = (int)config->sort_key;
+    cache->mask_cpu_schedstat = config->cpu_schedstat;
+    cache->mask_valid = true;
+}
 
-    if (g_sort_reverse)
-        result = -result;
-    return result;
+static int append_sample(process_cache *cache, pid_t pid) {
+    if (ensure_sample_capacity(cache, cache->sample_count + 1) != 0)
+        return -1;
+    proc_sample *sample = &cache->samples[cache->sample_count++];
+    sample->pid = pid;
+    sample->known = NULL;
+    sample->fd_slot = -1;
+    sample->valid = false;
+    sample->tasks_read = false;
+    sample->tasks_taken = false;
+    sample->task_count = 0;
+    sample->task_fd_limit = 0;
+    for (int f = 0; f < PROC_FILE_COUNT; ++f)
+        sample->fds[f] = -1;
+    return 0;
 }
 
-int process_list_refresh(process_list *list,
-                         process_cache *cache,
-                         double elapsed_seconds,
-                         const struct cupid_config *config) {
-    if (!list || !cache || !config)
+static void event_pid_gone(pid_t pid, void *ctx) {
+    proc_events_remove(ctx, pid);
+}
+
+static void event_pid_born(pid_t pid, void *ctx) {
+    proc_events_add(ctx, pid);
+}
+
+/* Brings the event-driven PID set in line with a full scan by applying
+ * only the differences. */
+static void reconcile_events(proc_events *events, const procfs_pid_scan *scan) {
+    size_t known_count = 0;
+    const pid_t *known = proc_events_pids(events, &known_count);
+    if (!known && known_count == 0 && events->count > 0) {
+        proc_events_clear(events);
+        for (size_t i = 0; i < scan->count; ++i)
+            proc_events_add(events, scan->pids[i]);
+        return;
+    }
+    procfs_diff_pids(known, known_count, scan->pids, scan->count, event_pid_gone, event_pid_born,
+                     events);
+    events->stale = false;
+}
+
+static int walk_proc_dir(process_cache *cache, proc_events *events) {
+    procfs_pid_scan *scan = &cache->pid_scan;
+    if (procfs_list_pids(scan) != 0 || ensure_sample_capacity(cache, scan->count) != 0) {
+        if (events)
+            events->stale = true;
         return -1;
+    }
+    for (size_t i = 0; i < scan->count; ++i) {
+        if (append_sample(cache, scan->pids[i]) != 0)
+            return -1;
+    }
+    if (events)
+        reconcile_events(events, scan);
+    return 0;
+}
+
+/* exec replaces the command line but often keeps comm (sh -c "exec sh
+ * ..."), so the comm check in sample_process() cannot be relied on. An
+ * empty comm matches no process and makes the next sample reload it. */
+static void forget_exec_commands(process_cache *cache, const proc_events *events) {
+    if (events->execs_lost) {
+        for (size_t i = 0; i < cache->capacity; ++i)
+            cache->entries[i].comm[0] = '\0';
+        return;
+    }
+    for (size_t i = 0; i < events->exec_count; ++i) {
+        proc_cpu_entry *entry = cache_find(cache, events->execs[i]);
+        if (entry)
+            entry->comm[0] = '\0';
+    }
+}
 
-    if (elapsed_seconds <= 0.0)
-        elapsed_seconds = 0.001;
+/* Fills cache->samples with the PIDs to sample, in ascending order.
+ * With proc_events the PIDs come from the live event-driven set and /proc
+ * is only walked every proc_events_rescan refreshes (or after the kernel
+ * dropped events) to reconcile it. Returns 1 when the event set was used,
+ * 0 after a /proc walk and -1 on error. */
+static int collect_pids(process_cache *cache, const cupid_config *config) {
+    cache->sample_count = 0;
+    proc_events *events = NULL;
+    if (config->proc_events && proc_events_open(&cache->events) == 0)
+        events = &cache->events;
+
+    if (events) {
+        proc_events_poll(events);
+        forget_exec_commands(cache, events);
+        if (!events->stale && ++cache->refreshes_since_rescan < (unsigned int)config->proc_events_rescan) {
+            size_t count = 0;
+            const pid_t *pids = proc_events_pids(events, &count);
+            if (pids || count == 0) {
+                for (size_t i = 0; i < count; ++i) {
+                    if (append_sample(cache, pids[i]) != 0)
+                        return -1;
+                }
+                return 1;
+            }
+        }
+        cache->refreshes_since_rescan = 0;
+    }
+    return walk_proc_dir(cache, events);
+}
 
-    ensure_system_constants();
+/* Writes one merged process into row. The row borrows user and command;
+ * the cache holds their references. */
+static void store_row(process_list *list, size_t row, const process_info *info, intern_id user,
+                      intern_id command, unsigned int generation) {
+    process_detail *detail = &list->detail[row];
+    detail->user = user;
+    detail->command = command;
+    detail->generation = generation;
+    list->pid[row] = info->pid;
+    list->ppid[row] = info->ppid;
+    list->cpu_percent[row] = info->cpu_percent;
+    list->mem_percent[row] = info->mem_percent;
+    list->rss_kb[row] = info->rss_kb;
+    detail->cpu_own = info->cpu_percent;
+    detail->uid = info->uid;
+    detail->state = info->state;
+    detail->threads = info->threads;
+    detail->vms_kb = info->vms_kb;
+    detail->cpu_time = info->cpu_time;
+    detail->swap_kb = info->swap_kb;
+    detail->nspid = info->nspid;
+    detail->ctxt_voluntary = info->ctxt_voluntary;
+    detail->ctxt_involuntary = info->ctxt_involuntary;
+    detail->pss_kb = info->pss_kb;
+    detail->uss_kb = info->uss_kb;
+    detail->swap_pss_kb = info->swap_pss_kb;
+    detail->smaps_age = info->smaps_age;
+    detail->io_read_rate = info->io_read_rate;
+    detail->io_write_rate = info->io_write_rate;
+    detail->io_cancelled_rate = info->io_cancelled_rate;
+    detail->runq_percent = info->runq_percent;
+    detail->sampled_at = info->sampled_at;
+}
+
+/* Copies row src over row dst; the columns derived by publish_list() are
+ * left alone. */
+static void move_row(process_list *list, size_t dst, size_t src) {
+    list->pid[dst] = list->pid[src];
+    list->ppid[dst] = list->ppid[src];
+    list->cpu_percent[dst] = list->cpu_percent[src];
+    list->mem_percent[dst] = list->mem_percent[src];
+    list->rss_kb[dst] = list->rss_kb[src];
+    list->detail[dst] = list->detail[src];
+}
+
+/* Incremental scans keep rows between slices. A row whose process was
+ * filtered out or exited is hidden at once and removed when the pass
+ * ends; its handles are cleared because the cache may release them. */
+static void drop_row(process_list *list, pid_t pid) {
+    size_t row = process_list_find(list, pid);
+    if (row == PROCESS_ROW_NONE)
+        return;
+    list->detail[row].generation = 0;
+    list->detail[row].user = 0;
+    list->detail[row].command = 0;
+}
+
+/* Removes the rows the finished pass did not refresh, keeping the others
+ * in their relative order. */
+static void compact_rows(process_list *list, unsigned int generation) {
+    size_t kept = 0;
+    for (size_t row = 0; row < list->rows; ++row) {
+        if (list->detail[row].generation != generation)
+            continue;
+        if (kept != row)
+            move_row(list, kept, row);
+        kept++;
+    }
+    list->rows = kept;
+}
+
+/* Processes that appeared during an incremental pass were appended after
+ * the rows already listed. Puts the rows back in PID order, as a full
+ * refresh lists them, by following the cycles of the sorting permutation.
+ * list->order is scratch here: publish_list() rebuilds it. */
+static void sort_rows_by_pid(process_list *list) {
+    size_t rows = list->rows;
+    size_t row = 1;
+    while (row < rows && list->pid[row - 1] < list->pid[row])
+        row++;
+    if (row >= rows)
+        return;
+    for (row = 0; row < rows; ++row)
+        list->order[row] = row;
+    qsort_r(list->order, rows, sizeof(*list->order), pid_asc, list);
+
+    /* order[dst] is the row that belongs at dst; settled slots point at themselves */
+    for (size_t start = 0; start < rows; ++start) {
+        if (list->order[start] == start)
+            continue;
+        pid_t pid = list->pid[start];
+        pid_t ppid = list->ppid[start];
+        double cpu_percent = list->cpu_percent[start];
+        double mem_percent = list->mem_percent[start];
+        long rss_kb = list->rss_kb[start];
+        process_detail detail = list->detail[start];
+        size_t dst = start;
+        while (list->order[dst] != start) {
+            size_t src = list->order[dst];
+            move_row(list, dst, src);
+            list->order[dst] = dst;
+            dst = src;
+        }
+        list->pid[dst] = pid;
+        list->ppid[dst] = ppid;
+        list->cpu_percent[dst] = cpu_percent;
+        list->mem_percent[dst] = mem_percent;
+        list->rss_kb[dst] = rss_kb;
+        list->detail[dst] = detail;
+        list->order[dst] = dst;
+    }
+}
+
+/* Phase 1: decide what to read and list the PIDs into cache->samples.
+ * Every sample of the pass is stamped with the same new generation. */
+static int begin_pass(process_cache *cache, const cupid_config *config) {
+    update_field_mask(cache, config);
+    fd_slots_configure(cache, config);
 
-    DIR *proc_dir = opendir("/proc");
-    if (!proc_dir)
+    int pid_source = collect_pids(cache, config);
+    if (pid_source < 0) {
+        cache->sample_count = 0;
         return -1;
+    }
+    cache->scan_from_events = pid_source == 1;
+    cache->scan_next = 0;
 
-    process_list_clear(list);
+    if (user_cache_validate(&cache->users, &cache->strings))
+        cache->scan_names_flushed = true;
+    if (cache->unknown_user == 0 && intern_acquire(&cache->strings, "?", &cache->unknown_user) != 0)
+        return -1;
 
-    process_cache new_cache;
-    process_cache_init(&new_cache);
+    /* Entries from the previous pass carry generation - 1 */
+    cache->generation++;
+    cache->pass_born = 0;
+    cache->pass_exited = 0;
+    return 0;
+}
+
+/* Phase 2 for samples [begin, end): lends each its cache entry and kept
+ * descriptors, then reads them serially or on the scan workers. */
+static void sample_range(process_cache *cache, const cupid_config *config, size_t begin, size_t end) {
+    bool keep_fds = cache->fd_slot_count > 0;
+    /* thread descriptors are shared out here, before the workers start:
+     * a process may keep as many as it had threads last time, plus some */
+    long spare = cache->task_fd_budget - cache->task_fds;
+    for (size_t i = begin; i < end; ++i) {
+        proc_sample *sample = &cache->samples[i];
+        proc_cpu_entry *known = cache_find(cache, sample->pid);
+        sample->known = known;
+        sample->task_fd_limit = 0;
+        if (known && keep_fds && known->fd_slot >= 0) {
+            sample->fd_slot = known->fd_slot;
+            /* mark it in use so no merge below recycles it */
+            cache->fd_slots[known->fd_slot].generation = cache->generation;
+            if (known->task_count > 0) {
+                long held = count_task_fds(known->tasks, known->task_count);
+                long limit = (long)known->task_count + TASK_FD_HEADROOM;
+                if (limit > held + spare)
+                    limit = held + spare;
+                if (limit < 0)
+                    limit = 0;
+                spare -= limit - held;
+                sample->task_fd_limit = (int)limit;
+            }
+        }
+    }
+    sample_all(cache, config, begin, end);
+}
 
+/* Phase 3 for samples [begin, end): folds them into the cache and writes
+ * their rows. A full refresh appends to a cleared list; an incremental
+ * slice (in_place) updates the rows it finds and appends new PIDs. CPU
+ * and I/O rates divide by the time between a process's own two stat
+ * reads, which in a long or sliced scan differs from process to process
+ * and from the time between refreshes. */
+static int merge_range(process_list *list,
+                       process_cache *cache,
+                       size_t begin,
+                       size_t end,
+                       bool in_place) {
+    bool keep_fds = cache->fd_slot_count > 0;
+    double now = monotonic_seconds();
     long mem_total_kb = read_mem_total_kb();
     if (mem_total_kb <= 0)
         mem_total_kb = 1;
 
-    struct dirent *entry;
-    while ((entry = readdir(proc_dir)) != NULL) {
-        if (!isdigit((unsigned char)entry->d_name[0]))
+    for (size_t i = begin; i < end; ++i) {
+        proc_sample *sample = &cache->samples[i];
+        pid_t pid = sample->pid;
+        if (!sample->valid) {
+            /* the process exited while we were looking at it */
+            if (sample->fd_slot >= 0) {
+                proc_cpu_entry *known = cache_find(cache, pid);
+                memcpy(cache->fd_slots[sample->fd_slot].fds, sample->fds, sizeof(sample->fds));
+                if (known)
+                    fd_slot_release(cache, known);
+            } else {
+                close_fds(sample->fds);
+            }
+            /* also covers an exit event we never received */
+            if (cache->scan_from_events)
+                proc_events_remove(&cache->events, pid);
+            if (in_place)
+                drop_row(list, pid);
             continue;
+        }
 
-        pid_t pid = (pid_t)strtol(entry->d_name, NULL, 10);
-        process_info info;
-        memset(&info, 0, sizeof(info));
-
-        unsigned long long total_ticks = 0;
-        if (read_process_stat(pid, &info, &total_ticks) != 0)
+        process_info info = sample->info;
+        unsigned long long total_ticks = sample->total_ticks;
+        unsigned long long starttime = sample->starttime;
+        if (sample->filtered) {
+            /* keep the CPU baseline so the process shows a rate once it matches */
+            proc_cpu_entry *slot = cache_insert(cache, pid);
+            if (!slot) {
+                discard_samples(cache, i);
+                return -1;
+            }
+            if (in_place)
+                drop_row(list, pid);
+            if (slot->starttime != starttime)
+                cache_entry_reset(cache, slot);
+            store_tasks(cache, slot, sample);
+            slot->starttime = starttime;
+            slot->total_ticks = total_ticks;
+            slot->generation = cache->generation;
+            slot->sample_time = sample->sampled_at;
+            slot->io_valid = false;
+            slot->sched_valid = sample->sched_valid;
+            slot->sched_cpu_ns = sample->sched.cpu_ns;
+            slot->sched_runq_ns = sample->sched.runq_ns;
+            if (keep_fds)
+                fd_slot_store(cache, slot, sample->fds);
+            else
+                close_fds(sample->fds);
             continue;
+        }
+        intern_id user = 0;
+        if (cache->field_mask & PROC_FIELD_USER) {
+            user = info.user[0] == '\0' ? user_cache_name(&cache->users, &cache->strings, info.uid)
+                                        : cache->unknown_user;
+        }
 
-        populate_user_info(pid, &info);
-        populate_thread_count(pid, &info);
-        char comm_copy[sizeof(info.command)];
-        strncpy(comm_copy, info.command, sizeof(comm_copy));
-        comm_copy[sizeof(comm_copy) - 1] = '\0';
-        load_cmdline(pid, comm_copy, info.command, sizeof(info.command));
-
-        bool found = false;
-        unsigned long long prev_ticks = cache_lookup(cache, pid, &found);
-        if (found && elapsed_seconds > 0.0) {
-            double delta_ticks = (double)(total_ticks - prev_ticks);
-            if (delta_ticks < 0)
-                delta_ticks = 0;
-            double cpu = (delta_ticks / (double)g_ticks_per_sec) / elapsed_seconds * 100.0;
+        proc_cpu_entry *slot = cache_insert(cache, pid);
+        if (!slot) {
+            discard_samples(cache, i);
+            return -1;
+        }
+        /* A different starttime means the PID was reused by a new process.
+         * An incremental pass that was started over leaves entries older
+         * than the last pass; their own sample time keeps the rate right. */
+        bool found = slot->generation != 0 && slot->generation != cache->generation &&
+                     slot->starttime == starttime;
+        unsigned long long prev_ticks = slot->total_ticks;
+        double interval = sample->sampled_at - slot->sample_time;
+        if (slot->starttime != starttime)
+            cache_entry_reset(cache, slot);
+        store_tasks(cache, slot, sample);
+        if (!sample->command_cached) {
+            intern_id command = 0;
+            bool stored = intern_acquire(&cache->strings, info.command, &command) == 0;
+            intern_release(&cache->strings, slot->command);
+            slot->command = command;
+            slot->command_full = stored && (cache->field_mask & PROC_FIELD_CMDLINE) != 0;
+            snprintf(slot->comm, sizeof(slot->comm), "%s", sample->comm);
+        }
+        slot->starttime = starttime;
+        slot->total_ticks = total_ticks;
+        slot->generation = cache->generation;
+        slot->sample_time = sample->sampled_at;
+        if (keep_fds)
+            fd_slot_store(cache, slot, sample->fds);
+        else
+            close_fds(sample->fds);
+        /* schedstat counts nanoseconds where stat counts clock ticks; a
+         * process without a schedstat baseline falls back to the ticks */
+        bool sched_found = found && slot->sched_valid && sample->sched_valid;
+        if (found && interval > 0.0) {
+            double busy;
+            if ((cache->field_mask & PROC_FIELD_SCHED_CPU) && sched_found) {
+                busy = counter_rate(slot->sched_cpu_ns, sample->sched.cpu_ns, interval) / 1e9;
+            } else {
+                double delta_ticks = (double)(total_ticks - prev_ticks);
+                if (delta_ticks < 0)
+                    delta_ticks = 0;
+                busy = (delta_ticks / (double)g_ticks_per_sec) / interval;
+            }
+            double cpu = busy * 100.0;
             if (g_cpu_count > 1)
                 cpu /= (double)g_cpu_count;
             if (cpu < 0.0)
@@ -440,63 +2121,216 @@ int process_list_refresh(process_list *list,
             info.cpu_percent = 0.0;
         }
 
+        info.cpu_time = (double)total_ticks / (double)g_ticks_per_sec;
         info.mem_percent = ((double)info.rss_kb / (double)mem_total_kb) * 100.0;
         if (info.mem_percent < 0.0)
             info.mem_percent = 0.0;
-
-        if (cache_append(&new_cache, pid, total_ticks) != 0) {
-            closedir(proc_dir);
-            process_cache_free(&new_cache);
-            return -1;
+        info.pss_kb = slot->pss_kb;
+        info.uss_kb = slot->uss_kb;
+        info.swap_pss_kb = slot->swap_pss_kb;
+        info.smaps_age = slot->smaps_time > 0.0 ? now - slot->smaps_time : -1.0;
+        info.sampled_at = sample->sampled_at;
+
+        /* I/O rates from counter deltas, like CPU; the first sight of a
+         * process only sets the baseline */
+        info.io_read_rate = -1.0;
+        info.io_write_rate = -1.0;
+        info.io_cancelled_rate = -1.0;
+        if (sample->io_denied)
+            slot->io_denied = true;
+        if (sample->io_valid) {
+            const proc_io_fields *io = &sample->io;
+            info.io_read_rate = 0.0;
+            info.io_write_rate = 0.0;
+            info.io_cancelled_rate = 0.0;
+            if (found && slot->io_valid) {
+                info.io_read_rate = counter_rate(slot->io_read_bytes, io->read_bytes, interval);
+                info.io_write_rate = counter_rate(slot->io_write_bytes, io->write_bytes, interval);
+                info.io_cancelled_rate =
+                    counter_rate(slot->io_cancelled_bytes, io->cancelled_write_bytes, interval);
+            }
+            slot->io_read_bytes = io->read_bytes;
+            slot->io_write_bytes = io->write_bytes;
+            slot->io_cancelled_bytes = io->cancelled_write_bytes;
         }
-
-        if (ensure_list_capacity(list, list->count + 1) != 0) {
-            closedir(proc_dir);
-            process_cache_free(&new_cache);
-            return -1;
+        slot->io_valid = sample->io_valid;
+
+        /* run-queue wait summed over threads, so it can pass 100% */
+        info.runq_percent = -1.0;
+        if (sample->sched_valid) {
+            info.runq_percent = 0.0;
+            if (sched_found && interval > 0.0)
+                info.runq_percent =
+                    counter_rate(slot->sched_runq_ns, sample->sched.runq_ns, interval) / 1e7;
+            slot->sched_cpu_ns = sample->sched.cpu_ns;
+            slot->sched_runq_ns = sample->sched.runq_ns;
         }
-        list->items[list->count++] = info;
-    }
-
-    closedir(proc_dir);
-
-    /* Optional CPU grouping: aggregate children into parents for tree view */
-    if (config->cpu_group_mode == CPU_GROUP_AGGREGATE &&
-        config->tree_view_default != TREE_VIEW_FLAT && list->count > 0) {
-        double *agg = calloc(list->count, sizeof(double));
-        if (agg) {
-            for (size_t i = 0; i < list->count; ++i)
-                agg[i] = list->items[i].cpu_percent;
-            for (size_t i = 0; i < list->count; ++i) {
-                pid_t ppid = list->items[i].ppid;
-                for (size_t j = 0; j < list->count; ++j) {
-                    if (list->items[j].pid == ppid) {
-                        agg[j] += list->items[i].cpu_percent;
-                        break;
-                    }
-                }
+        slot->sched_valid = sample->sched_valid;
+
+        if (cache->filter) {
+            const char *user_name = user ? intern_str(&cache->strings, user) : NULL;
+            filter_subject subject = {&info, slot->comm, user_name,
+                                      intern_str(&cache->strings, slot->command),
+                                      info.user[0] != '\0'};
+            if (filter_eval(cache->filter, &subject, FILTER_STAGE_ALL) != FILTER_TRUE) {
+                if (in_place)
+                    drop_row(list, pid);
+                continue;
             }
-            for (size_t i = 0; i < list->count; ++i) {
-                double v = agg[i];
-                if (v < 0.0)
-                    v = 0.0;
-                if (v > 100.0)
-                    v = 100.0;
-                list->items[i].cpu_percent = v;
+        }
+
+        size_t row = in_place ? process_list_find(list, pid) : PROCESS_ROW_NONE;
+        if (row == PROCESS_ROW_NONE) {
+            if (ensure_list_capacity(list, list->rows + 1) != 0) {
+                discard_samples(cache, i + 1);
+                return -1;
             }
-            free(agg);
+            row = list->rows++;
         }
+        store_row(list, row, &info, user, slot->command, cache->generation);
+    }
+    return 0;
+}
+
+/* Rebuilds the derived state of the list after rows changed: the pid
+ * index and tree links, smaps samples, rollups and the visible order. */
+static int publish_list(process_list *list, process_cache *cache, const cupid_config *config) {
+    /* hidden rows go after the live ones, where max_processes cuts */
+    size_t live = 0;
+    for (size_t row = 0; row < list->rows; ++row) {
+        if (list->detail[row].generation != 0)
+            list->order[live++] = row;
+    }
+    size_t hidden = live;
+    for (size_t row = 0; row < list->rows; ++row) {
+        if (list->detail[row].generation == 0)
+            list->order[hidden++] = row;
     }
+    list->count = live;
+    list->sorted = 0;
 
-    g_sort_key = config->default_sort;
-    g_sort_reverse = config->sort_reverse;
-    qsort(list->items, list->count, sizeof(process_info), process_compare);
+    if (index_parents(list) != 0)
+        return -1;
+    /* once per pass, so incremental scans spend the same budget */
+    if ((cache->field_mask & PROC_FIELD_SMAPS) && !cache->scan_active)
+        sample_smaps(list, cache, config->smaps_budget_ms);
+
+    /* Optional CPU grouping: parents show their whole tree's CPU in tree view */
+    bool aggregate = config->cpu_group_mode == CPU_GROUP_AGGREGATE &&
+                     config->tree_view_default != TREE_VIEW_FLAT;
+    if (aggregate || (cache->field_mask & PROC_FIELD_TREE))
+        rollup_subtrees(list);
+    if (aggregate) {
+        for (size_t i = 0; i < list->rows; ++i) {
+            double v = list->detail[i].cpu_tree;
+            if (v < 0.0)
+                v = 0.0;
+            if (v > 100.0)
+                v = 100.0;
+            list->cpu_percent[i] = v;
+        }
+    }
 
-    if (config->max_processes > 0 && list->count > (size_t)config->max_processes)
+    /* Only the rows that can be shown need a full order: select the
+     * max_processes survivors, then sort just the visible window of them.
+     * Tree view orders siblings by list position, so it sorts everything. */
+    process_comparator cmp = process_list_comparator(config);
+    if (config->sort_key == SORT_KEY_NAME)
+        intern_update_ranks(&cache->strings); /* on failure names compare as text */
+    if (config->max_processes > 0 && list->count > (size_t)config->max_processes) {
+        select_first(list->order, list->count, (size_t)config->max_processes, cmp, list);
         list->count = (size_t)config->max_processes;
+    }
+    size_t k = list->count;
+    if (config->tree_view_default == TREE_VIEW_FLAT && cache->visible_rows > 0 &&
+        cache->visible_rows < k) {
+        k = cache->visible_rows;
+        select_first(list->order, list->count, k, cmp, list);
+    }
+    qsort_r(list->order, k, sizeof(*list->order), cmp, list);
+    list->sorted = k;
+    link_children(list);
+    return 0;
+}
+
+/* One slice of an incremental pass: samples and merges chunks of the PID
+ * list until scan_slice_ms is spent, then publishes the list with the
+ * rows refreshed so far next to the ones from the previous pass. */
+static int refresh_slice(process_list *list, process_cache *cache, const cupid_config *config) {
+    if (!cache->scan_active) {
+        if (begin_pass(cache, config) != 0)
+            return -1;
+        cache->scan_active = true;
+    }
+    /* a flushed uid cache released the names older rows still point to */
+    if (cache->scan_names_flushed) {
+        process_list_clear(list);
+        cache->scan_names_flushed = false;
+    }
 
-    cache_replace(cache, &new_cache);
+    int workers = scan_worker_count(config);
+    size_t chunk = SCAN_CHUNK * (size_t)(workers > 1 ? workers : 1);
+    double deadline = monotonic_seconds() + (double)config->scan_slice_ms / 1000.0;
+    while (cache->scan_next < cache->sample_count) {
+        size_t begin = cache->scan_next;
+        size_t end = begin + chunk < cache->sample_count ? begin + chunk : cache->sample_count;
+        sample_range(cache, config, begin, end);
+        if (merge_range(list, cache, begin, end, true) != 0) {
+            cache->scan_active = false;
+            return -1;
+        }
+        cache->scan_next = end;
+        if (monotonic_seconds() >= deadline)
+            break;
+    }
 
-    return 0;
+    if (cache->scan_next == cache->sample_count) {
+        compact_rows(list, cache->generation);
+        sort_rows_by_pid(list);
+        cache->sample_count = 0;
+        cache_sweep(cache);
+        cache->scan_active = false;
+    }
+    return publish_list(list, cache, config);
 }
 
+bool process_cache_scan_pending(const process_cache *cache) {
+    return cache && cache->scan_active;
+}
+
+/*
+ * A refresh runs in three phases:
+ *  1. list the PIDs in /proc (serial),
+ *  2. sample every PID (serial, or spread over scan_threads workers),
+ *  3. merge the samples into the cache and the list in /proc order (serial).
+ * Only phase 3 touches shared state, so the result does not depend on the
+ * number of workers. With scan_slice_ms set, phases 2 and 3 run a bounded
+ * slice of the PIDs per call instead (see refresh_slice()).
+ */
+int process_list_refresh(process_list *list, process_cache *cache, const struct cupid_config *config) {
+    if (!list || !cache || !config)
+        return -1;
+
+    ensure_system_constants();
+    list->strings = &cache->strings;
+    if (config->scan_slice_ms > 0)
+        return refresh_slice(list, cache, config);
+
+    /* a pass left unfinished by turning incremental scans off */
+    if (cache->scan_active) {
+        discard_samples(cache, cache->scan_next);
+        cache->scan_active = false;
+    }
+    if (begin_pass(cache, config) != 0)
+        return -1;
+    cache->scan_names_flushed = false;
+
+    sample_range(cache, config, 0, cache->sample_count);
+    process_list_clear(list);
+    if (merge_range(list, cache, 0, cache->sample_count, false) != 0)
+        return -1;
+    cache->sample_count = 0;
+
+    cache_sweep(cache);
+    return publish_list(list, cache, config);
+}
@@ -3,7 +3,13 @@
 #include <stdbool.h>
 #include <stddef.h>
 #include <sys/types.h>
+#include <time.h>
 
+#include "intern.h"
+#include "proc_events.h"
+#include "procfs.h"
+
+/* One process as read by the sampler. The list stores it column-wise. */
 typedef struct {
     pid_t pid;
     pid_t ppid;
@@ -16,23 +22,244 @@ typedef struct {
     long rss_kb;
     long vms_kb;
     int threads;
+    double cpu_time; /* user + system seconds since start */
+    long swap_kb;
+    pid_t nspid;     /* pid inside its own PID namespace */
+    unsigned long long ctxt_voluntary;
+    unsigned long long ctxt_involuntary;
+    long pss_kb;      /* from smaps_rollup, see smaps_age */
+    long uss_kb;
+    long swap_pss_kb;
+    double smaps_age; /* seconds since the three above were read, -1 = never */
+    double io_read_rate;      /* bytes/s from /proc/<pid>/io, -1 = unavailable */
+    double io_write_rate;
+    double io_cancelled_rate;
+    double runq_percent;      /* time spent waiting for a CPU, % of the interval, -1 = unavailable */
+    double sampled_at;        /* CLOCK_MONOTONIC seconds when the values were read */
 } process_info;
 
+/* Fields only needed to draw a row. */
 typedef struct {
-    process_info *items;
-    size_t count;
+    uid_t uid;
+    char state;
+    int threads;
+    long vms_kb;
+    double cpu_time; /* user + system seconds since start */
+    long swap_kb;
+    pid_t nspid;
+    unsigned long long ctxt_voluntary;
+    unsigned long long ctxt_involuntary;
+    double cpu_tree; /* inclusive of all descendants, with PROC_FIELD_TREE */
+    long rss_tree;
+    int threads_tree;
+    long pss_kb;
+    long uss_kb;
+    long swap_pss_kb;
+    double smaps_age;
+    double io_read_rate;
+    double io_write_rate;
+    double io_cancelled_rate;
+    double runq_percent;
+    double sampled_at;
+    double cpu_own;  /* cpu_percent before aggregate mode replaces it with cpu_tree */
+    unsigned int generation; /* pass that wrote the row, 0 = hidden until removed */
+    intern_id user;
+    intern_id command;
+} process_detail;
+
+#define PROCESS_ROW_NONE ((size_t)-1)
+
+/* Columnar process table. Rows are stored in PID order and never move;
+ * sorting permutes order[], which maps display positions to rows.
+ * Incremental scans append new PIDs at the end and compact the rows of
+ * exited processes once per pass. The
+ * columns sorting and the tree walk touch stay in their own arrays. */
+typedef struct {
+    size_t count;    /* displayed rows, order[0, count) */
+    size_t rows;     /* stored rows */
     size_t capacity;
+    size_t sorted;   /* order[0, sorted) is final, the rest follows it unordered */
+
+    pid_t *pid;
+    pid_t *ppid;
+    double *cpu_percent;
+    double *mem_percent;
+    long *rss_kb;
+    process_detail *detail;
+    size_t *order;
+
+    /* Process tree, rebuilt every refresh. Children are linked in display
+     * order; a process whose parent is not listed is a root. */
+    size_t *parent;       /* row of the listed parent, PROCESS_ROW_NONE for roots */
+    size_t *first_child;  /* PROCESS_ROW_NONE when childless */
+    size_t *next_sibling;
+    size_t *index;        /* pid -> row + 1, open addressing, 0 = empty */
+    size_t index_capacity;
+
+    const intern_pool *strings; /* resolves user/command, owned by the process_cache */
 } process_list;
 
+/* One thread of a multithreaded process at its last schedstat read. */
 typedef struct {
-    pid_t pid;
+    pid_t tid;
+    int fd;                       /* task/<tid>/schedstat kept open, or -1 */
+    unsigned long long cpu_ns;
+    unsigned long long runq_ns;
+} proc_task_sched;
+
+typedef struct {
+    pid_t pid;                    /* 0 marks an empty slot */
+    unsigned long long starttime; /* with pid, identifies one process incarnation */
     unsigned long long total_ticks;
+    unsigned int generation;      /* last refresh that saw this process */
+    int fd_slot;                  /* index into process_cache.fd_slots, -1 if none */
+    char comm[64];                /* comm the cached command belongs to */
+    intern_id command;            /* reused until comm changes */
+    bool command_full;            /* command is the cmdline rather than comm */
+    double sample_time;           /* CLOCK_MONOTONIC seconds of the last stat read */
+    bool smaps_denied;            /* smaps_rollup is not readable, do not retry */
+    long pss_kb;                  /* last smaps_rollup totals */
+    long uss_kb;
+    long swap_pss_kb;
+    double smaps_time;            /* CLOCK_MONOTONIC seconds of that read, 0 = never */
+    bool io_denied;               /* /proc/<pid>/io is not readable, do not retry */
+    bool io_valid;                /* the io counters below are a baseline for rates */
+    unsigned long long io_read_bytes;
+    unsigned long long io_write_bytes;
+    unsigned long long io_cancelled_bytes;
+    bool sched_valid;             /* the schedstat counters below are a baseline */
+    unsigned long long sched_cpu_ns;
+    unsigned long long sched_runq_ns;
+    proc_task_sched *tasks;       /* per-thread counters behind sched_*, sorted by tid; */
+    size_t task_count;            /* empty while the process is single-threaded */
+    size_t task_capacity;
 } proc_cpu_entry;
 
+/* What a refresh has to collect, derived from the configured columns and
+ * sort key. /proc/<pid>/stat is always read. */
+enum {
+    PROC_FIELD_STATUS = 1u << 0,  /* uid, threads, swap, context switches, nspid */
+    PROC_FIELD_USER = 1u << 1,    /* uid -> name lookup, implies STATUS */
+    PROC_FIELD_CMDLINE = 1u << 2, /* full command line instead of comm */
+    PROC_FIELD_TREE = 1u << 3,    /* subtree rollups */
+    PROC_FIELD_SMAPS = 1u << 4,   /* pss, uss, swap_pss from smaps_rollup, round-robin */
+    PROC_FIELD_IO = 1u << 5,      /* storage I/O rates from /proc/<pid>/io */
+    PROC_FIELD_SCHEDSTAT = 1u << 6, /* run-queue wait from /proc/<pid>/schedstat */
+    PROC_FIELD_SCHED_CPU = 1u << 7, /* CPU% from schedstat nanoseconds, implies SCHEDSTAT */
+};
+
+enum {
+    PROC_FILE_STAT = 0,
+    PROC_FILE_STATUS,
+    PROC_FILE_CMDLINE,
+    PROC_FILE_IO,
+    PROC_FILE_SCHEDSTAT,
+    PROC_FILE_COUNT
+};
+
+/* Open /proc/<pid> files kept across refreshes when persistent_fds is set.
+ * Slots form a doubly linked LRU list, most recently used first. */
+typedef struct {
+    pid_t pid; /* owner, 0 when the slot is free */
+    int fds[PROC_FILE_COUNT];
+    unsigned int generation; /* refresh that last used the slot */
+    int prev;
+    int next;
+} proc_fd_slot;
+
+/* Raw per-PID reading produced by the sampling phase of a refresh. */
+typedef struct {
+    pid_t pid;
+    bool valid;                /* stat was read successfully */
+    bool command_cached;       /* reuse the cache entry's command, info.command is stale */
+    bool filtered;             /* the filter rejected it before the remaining reads */
+    bool io_valid;             /* io holds fresh counters */
+    bool io_denied;            /* /proc/<pid>/io refused the read */
+    bool sched_valid;          /* sched holds fresh counters */
+    const proc_cpu_entry *known; /* cache entry, only valid while sampling */
+    int fd_slot;               /* slot the descriptors were borrowed from, -1 if none */
+    int fds[PROC_FILE_COUNT];
+    unsigned long long total_ticks;
+    unsigned long long starttime;
+    double sampled_at;         /* CLOCK_MONOTONIC seconds right after the stat read */
+    char comm[64];
+    proc_io_fields io;
+    proc_schedstat_fields sched; /* over all threads, see read_process_tasks() */
+    proc_task_sched *tasks;    /* per-thread reads, swapped with the entry's by the merge */
+    size_t task_count;
+    size_t task_capacity;      /* tasks is scratch kept with the sample across refreshes */
+    bool tasks_read;           /* tasks holds this refresh's threads */
+    bool tasks_taken;          /* the entry's thread descriptors were moved into tasks */
+    int task_fd_limit;         /* thread descriptors tasks may keep open */
+    process_info info;
+} proc_sample;
+
+struct scan_pool;
+
+typedef struct {
+    uid_t uid;
+    bool used;
+    bool found; /* false caches a failed lookup; name holds the numeric uid */
+    intern_id name;
+} uid_name_entry;
+
+/* uid -> user name, kept across refreshes and flushed when /etc/passwd
+ * changes. */
+typedef struct {
+    uid_name_entry *entries; /* open-addressing, capacity is a power of two */
+    size_t count;
+    size_t capacity;
+    struct timespec passwd_mtime;
+} uid_name_cache;
+
+/* Open-addressing (linear probing) table of per-PID samples, kept across
+ * refreshes. capacity is always zero or a power of two. */
 typedef struct {
     proc_cpu_entry *entries;
     size_t count;
     size_t capacity;
+    unsigned int generation;
+
+    proc_fd_slot *fd_slots;
+    int fd_slot_count;
+    int fd_lru_head;
+    int fd_lru_tail;
+    int fd_free; /* free slots chained through next */
+    long task_fd_budget; /* thread schedstat descriptors persistent_fds may keep */
+    long task_fds;       /* of those, open right now */
+
+    proc_sample *samples; /* scratch for the current refresh, one per PID */
+    size_t sample_count;
+    size_t sample_capacity;
+    struct scan_pool *pool; /* worker threads for scan_threads > 1 */
+
+    size_t visible_rows;       /* rows the UI shows, bounds the sort; 0 = sort all */
+
+    unsigned int field_mask;   /* PROC_FIELD_* compiled from the config below */
+    char mask_columns[128];
+    int mask_sort;             /* sort_key_t */
+    bool mask_cpu_schedstat;
+    bool background;           /* the UI is out of focus: skip the costly reads */
+    bool mask_valid;
+    struct process_filter *filter; /* rows must match it; NULL shows everything */
+
+    uid_name_cache users;
+    intern_pool strings;       /* user names and commands, shared by equal strings */
+    intern_id unknown_user;    /* "?", for processes whose status could not be read */
+    procfs_pid_scan pid_scan;        /* last /proc listing, reused between walks */
+    proc_events events;              /* live PID set when proc_events is on */
+    unsigned int refreshes_since_rescan;
+    pid_t smaps_cursor;              /* last PID whose smaps_rollup was read */
+
+    /* incremental scans: samples[] holds the PIDs of the current pass */
+    bool scan_active;                /* a pass is part way through samples */
+    size_t scan_next;                /* first sample of the next slice */
+    bool scan_from_events;           /* the pass took its PIDs from proc_events */
+    bool scan_names_flushed;         /* user names were released mid-pass */
+
+    /* process churn of the current (or last completed) pass */
+    size_t pass_born;                /* PIDs first seen, reused ones included */
+    size_t pass_exited;
 } process_cache;
 
 struct cupid_config;
@@ -40,12 +267,39 @@ struct cupid_config;
 void process_list_init(process_list *list);
 void process_list_clear(process_list *list);
 void process_list_free(process_list *list);
+const char *process_list_user(const process_list *list, size_t row);
+const char *process_list_command(const process_list *list, size_t row);
+// Row of pid, or PROCESS_ROW_NONE if it is not in the list.
+size_t process_list_find(const process_list *list, pid_t pid);
+// Copy rows, order and tree into dst, reusing its columns. dst->strings
+// still points at src's pool; repoint it when the copy outlives that.
+int process_list_copy(process_list *dst, const process_list *src);
 
 void process_cache_init(process_cache *cache);
 void process_cache_free(process_cache *cache);
 
-int process_list_refresh(process_list *list,
-                         process_cache *cache,
-                         double elapsed_seconds,
-                         const struct cupid_config *config);
+// Tell the next refreshes how many leading rows the UI needs in order.
+void process_cache_set_visible_rows(process_cache *cache, size_t rows);
+
+// Out of focus, refreshes read no smaps_rollup, io, schedstat or new command
+// lines unless the filter needs them; rows keep their cached commands.
+void process_cache_set_background(process_cache *cache, bool background);
+
+// Compile expr into the cache's filter; NULL or blank clears it. On a syntax
+// error returns -1, keeps the previous filter and describes the problem in err.
+int process_cache_set_filter(process_cache *cache, const char *expr, char *err, size_t errlen);
+
+// Rates (CPU%, I/O) use each process's own interval between samples.
+int process_list_refresh(process_list *list, process_cache *cache, const struct cupid_config *config);
+
+// True while an incremental scan (scan_slice_ms) is part way through a pass.
+bool process_cache_scan_pending(const process_cache *cache);
+
+// Complete the ordering once the UI needs rows past list->sorted.
+void process_list_ensure_sorted(process_list *list, const struct cupid_config *config, size_t rows);
+
+// qsort_r() comparator over row indices for config's sort key; the context
+// is the list. Equal keys fall back to the row, which is in PID order.
+typedef int (*process_comparator)(const void *, const void *, void *);
+process_comparator process_list_comparator(const struct cupid_config *config);
 
@@ -0,0 +1,431 @@
+#define _GNU_SOURCE
+
+#include "procfs.h"
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+static inline bool is_digit(char c) {
+    return (unsigned char)(c - '0') < 10;
+}
+
+/* Advances *p past count space separated fields. */
+static inline void skip_fields(const char **p, const char *end, int count) {
+    const char *s = *p;
+    while (count > 0 && s < end) {
+        while (s < end && *s != ' ')
+            s++;
+        if (s < end)
+            s++;
+        count--;
+    }
+    *p = s;
+}
+
+/* Accumulates the digits of the current field and steps onto the next one. */
+static inline unsigned long long take_ull(const char **p, const char *end) {
+    const char *s = *p;
+    unsigned long long value = 0;
+    while (s < end && is_digit(*s))
+        value = value * 10 + (unsigned long long)(*s++ - '0');
+    while (s < end && *s != ' ')
+        s++;
+    if (s < end)
+        s++;
+    *p = s;
+    return value;
+}
+
+static inline long long take_ll(const char **p, const char *end) {
+    bool negative = *p < end && **p == '-';
+    if (negative)
+        (*p)++;
+    long long value = (long long)take_ull(p, end);
+    return negative ? -value : value;
+}
+
+int procfs_parse_stat(const char *buf, size_t len, proc_stat_fields *out) {
+    if (!buf || !out || len == 0)
+        return -1;
+    const char *p = buf;
+    const char *end = buf + len;
+
+    if (!is_digit(*p))
+        return -1;
+    out->pid = (pid_t)take_ull(&p, end);
+
+    /* comm may itself contain spaces and ')', so anchor on the last one */
+    if (p >= end || *p != '(')
+        return -1;
+    const char *close = memrchr(p, ')', (size_t)(end - p));
+    if (!close)
+        return -1;
+    out->comm = p + 1;
+    out->comm_len = (size_t)(close - (p + 1));
+
+    p = close + 2; /* skip ") " */
+    if (p >= end)
+        return -1;
+
+    out->state = *p;            /* field 3 */
+    skip_fields(&p, end, 1);
+    out->ppid = (pid_t)take_ll(&p, end); /* 4 */
+    skip_fields(&p, end, 9);    /* 5..13 */
+    out->utime = take_ull(&p, end);     /* 14 */
+    out->stime = take_ull(&p, end);     /* 15 */
+    skip_fields(&p, end, 4);    /* 16..19 */
+    out->num_threads = take_ll(&p, end); /* 20 */
+    skip_fields(&p, end, 1);    /* 21 */
+    out->starttime = take_ull(&p, end); /* 22 */
+    out->vsize = take_ull(&p, end);     /* 23 */
+    if (p >= end)
+        return -1;
+    out->rss = take_ll(&p, end);        /* 24 */
+    return 0;
+}
+
+/* Parses the whitespace separated numbers after a status key. */
+static const char *status_number(const char *p, const char *end, unsigned long long *value) {
+    while (p < end && (*p == ' ' || *p == '\t'))
+        p++;
+    unsigned long long v = 0;
+    while (p < end && is_digit(*p))
+        v = v * 10 + (unsigned long long)(*p++ - '0');
+    *value = v;
+    return p;
+}
+
+static void status_uid(const char *p, const char *end, proc_status_fields *out) {
+    unsigned long long ruid;
+    unsigned long long euid;
+    p = status_number(p, end, &ruid);
+    status_number(p, end, &euid);
+    out->ruid = (unsigned int)ruid;
+    out->euid = (unsigned int)euid;
+}
+
+static void status_threads(const char *p, const char *end, proc_status_fields *out) {
+    unsigned long long v;
+    status_number(p, end, &v);
+    out->threads = (int)v;
+}
+
+static void status_vmrss(const char *p, const char *end, proc_status_fields *out) {
+    unsigned long long v;
+    status_number(p, end, &v);
+    out->vm_rss_kb = (long)v;
+}
+
+static void status_vmswap(const char *p, const char *end, proc_status_fields *out) {
+    unsigned long long v;
+    status_number(p, end, &v);
+    out->vm_swap_kb = (long)v;
+}
+
+/* NSpid lists the PID from the outermost to the innermost namespace. */
+static void status_nspid(const char *p, const char *end, proc_status_fields *out) {
+    unsigned long long v = 0;
+    while (p < end) {
+        p = status_number(p, end, &v);
+        while (p < end && (*p == ' ' || *p == '\t'))
+            p++;
+        if (p < end && !is_digit(*p))
+            break;
+    }
+    out->nspid = (pid_t)v;
+}
+
+static void status_vcsw(const char *p, const char *end, proc_status_fields *out) {
+    status_number(p, end, &out->voluntary_ctxt_switches);
+}
+
+static void status_nvcsw(const char *p, const char *end, proc_status_fields *out) {
+    status_number(p, end, &out->nonvoluntary_ctxt_switches);
+}
+
+static const struct {
+    const char *key; /* including the colon */
+    unsigned char len;
+    unsigned int bit;
+    void (*parse)(const char *p, const char *end, proc_status_fields *out);
+} status_keys[] = {
+    {"Uid:", 4, PROC_STATUS_HAS_UID, status_uid},
+    {"NSpid:", 6, PROC_STATUS_HAS_NSPID, status_nspid},
+    {"VmRSS:", 6, PROC_STATUS_HAS_VMRSS, status_vmrss},
+    {"VmSwap:", 7, PROC_STATUS_HAS_VMSWAP, status_vmswap},
+    {"Threads:", 8, PROC_STATUS_HAS_THREADS, status_threads},
+    {"voluntary_ctxt_switches:", 24, PROC_STATUS_HAS_VCSW, status_vcsw},
+    {"nonvoluntary_ctxt_switches:", 27, PROC_STATUS_HAS_NVCSW, status_nvcsw},
+};
+
+#define STATUS_KEY_COUNT (sizeof(status_keys) / sizeof(status_keys[0]))
+
+int procfs_parse_status(const char *buf, size_t len, proc_status_fields *out) {
+    if (!buf || !out || len == 0)
+        return -1;
+    memset(out, 0, sizeof(*out));
+    const unsigned int all = (1u << STATUS_KEY_COUNT) - 1;
+    const char *end = buf + len;
+    const char *line = buf;
+    while (line < end && out->present != all) {
+        const char *eol = memchr(line, '\n', (size_t)(end - line));
+        if (!eol)
+            eol = end;
+        const char *colon = memchr(line, ':', (size_t)(eol - line));
+        if (colon) {
+            size_t key_len = (size_t)(colon - line) + 1;
+            for (size_t i = 0; i < STATUS_KEY_COUNT; ++i) {
+                if (status_keys[i].len == key_len && !(out->present & status_keys[i].bit) &&
+                    memcmp(status_keys[i].key, line, key_len) == 0) {
+                    status_keys[i].parse(colon + 1, eol, out);
+                    out->present |= status_keys[i].bit;
+                    break;
+                }
+            }
+        }
+        line = eol + 1;
+    }
+    return out->present ? 0 : -1;
+}
+
+static const struct {
+    const char *key; /* including the colon */
+    unsigned char len;
+    size_t offset;   /* of the long in proc_smaps_fields */
+} smaps_keys[] = {
+    {"Rss:", 4, offsetof(proc_smaps_fields, rss_kb)},
+    {"Pss:", 4, offsetof(proc_smaps_fields, pss_kb)},
+    {"Private_Clean:", 14, offsetof(proc_smaps_fields, private_clean_kb)},
+    {"Private_Dirty:", 14, offsetof(proc_smaps_fields, private_dirty_kb)},
+    {"SwapPss:", 8, offsetof(proc_smaps_fields, swap_pss_kb)},
+};
+
+#define SMAPS_KEY_COUNT (sizeof(smaps_keys) / sizeof(smaps_keys[0]))
+
+int procfs_parse_smaps_rollup(const char *buf, size_t len, proc_smaps_fields *out) {
+    if (!buf || !out)
+        return -1;
+    memset(out, 0, sizeof(*out));
+    const unsigned int all = (1u << SMAPS_KEY_COUNT) - 1;
+    unsigned int found = 0;
+    const char *end = buf + len;
+    const char *line = buf;
+    /* the first line names the VMA range, the totals follow */
+    while (line < end && found != all) {
+        const char *eol = memchr(line, '\n', (size_t)(end - line));
+        if (!eol)
+            eol = end;
+        const char *colon = memchr(line, ':', (size_t)(eol - line));
+        if (colon) {
+            size_t key_len = (size_t)(colon - line) + 1;
+            for (size_t i = 0; i < SMAPS_KEY_COUNT; ++i) {
+                if (smaps_keys[i].len == key_len && memcmp(smaps_keys[i].key, line, key_len) == 0) {
+                    unsigned long long v;
+                    status_number(colon + 1, eol, &v);
+                    *(long *)((char *)out + smaps_keys[i].offset) = (long)v;
+                    found |= 1u << i;
+                    break;
+                }
+            }
+        }
+        line = eol + 1;
+    }
+    return (found & (1u << 1)) ? 0 : -1; /* Pss */
+}
+
+static const struct {
+    const char *key; /* including the colon */
+    unsigned char len;
+    size_t offset;   /* of the counter in proc_io_fields */
+} io_keys[] = {
+    {"read_bytes:", 11, offsetof(proc_io_fields, read_bytes)},
+    {"write_bytes:", 12, offsetof(proc_io_fields, write_bytes)},
+    {"cancelled_write_bytes:", 22, offsetof(proc_io_fields, cancelled_write_bytes)},
+};
+
+#define IO_KEY_COUNT (sizeof(io_keys) / sizeof(io_keys[0]))
+
+int procfs_parse_io(const char *buf, size_t len, proc_io_fields *out) {
+    if (!buf || !out)
+        return -1;
+    memset(out, 0, sizeof(*out));
+    const unsigned int all = (1u << IO_KEY_COUNT) - 1;
+    unsigned int found = 0;
+    const char *end = buf + len;
+    const char *line = buf;
+    while (line < end && found != all) {
+        const char *eol = memchr(line, '\n', (size_t)(end - line));
+        if (!eol)
+            eol = end;
+        const char *colon = memchr(line, ':', (size_t)(eol - line));
+        if (colon) {
+            size_t key_len = (size_t)(colon - line) + 1;
+            for (size_t i = 0; i < IO_KEY_COUNT; ++i) {
+                if (io_keys[i].len == key_len && memcmp(io_keys[i].key, line, key_len) == 0) {
+                    status_number(colon + 1, eol,
+                                  (unsigned long long *)((char *)out + io_keys[i].offset));
+                    found |= 1u << i;
+                    break;
+                }
+            }
+        }
+        line = eol + 1;
+    }
+    return found == all ? 0 : -1;
+}
+
+int procfs_parse_schedstat(const char *buf, size_t len, proc_schedstat_fields *out) {
+    if (!buf || !out || len == 0 || !is_digit(*buf))
+        return -1;
+    const char *p = buf;
+    const char *end = buf + len;
+    out->cpu_ns = take_ull(&p, end);
+    if (p >= end || !is_digit(*p))
+        return -1;
+    out->runq_ns = take_ull(&p, end);
+    if (p >= end || !is_digit(*p))
+        return -1;
+    out->timeslices = take_ull(&p, end);
+    return 0;
+}
+
+#define PID_SCAN_BUF_SIZE (64 * 1024)
+
+struct linux_dirent64 {
+    uint64_t d_ino;
+    int64_t d_off;
+    unsigned short d_reclen;
+    unsigned char d_type;
+    char d_name[];
+};
+
+void procfs_pid_scan_init(procfs_pid_scan *scan) {
+    if (!scan)
+        return;
+    memset(scan, 0, sizeof(*scan));
+    scan->dir_fd = -1;
+}
+
+void procfs_pid_scan_free(procfs_pid_scan *scan) {
+    if (!scan)
+        return;
+    if (scan->dir_fd >= 0)
+        close(scan->dir_fd);
+    free(scan->buf);
+    free(scan->pids);
+    procfs_pid_scan_init(scan);
+}
+
+#define PID_DIGIT(i)                                \
+    d = (unsigned int)(unsigned char)name[i] - '0'; \
+    if (d > 9)                                      \
+        return name[i] == '\0' ? (pid_t)v : 0;      \
+    v = v * 10 + d;
+
+/* PIDs fit in 7 digits (PID_MAX_LIMIT is 4194304); anything longer or not
+ * purely numeric yields 0. */
+static pid_t parse_pid_name(const char *name) {
+    unsigned int d = (unsigned int)(unsigned char)name[0] - '0';
+    if (d > 9 || d == 0)
+        return 0;
+    unsigned int v = d;
+    PID_DIGIT(1)
+    PID_DIGIT(2)
+    PID_DIGIT(3)
+    PID_DIGIT(4)
+    PID_DIGIT(5)
+    PID_DIGIT(6)
+    return name[7] == '\0' ? (pid_t)v : 0;
+}
+
+#undef PID_DIGIT
+
+static int pid_order(const void *lhs, const void *rhs) {
+    pid_t a = *(const pid_t *)lhs;
+    pid_t b = *(const pid_t *)rhs;
+    return (a > b) - (a < b);
+}
+
+/* Reads /proc with raw getdents64 into one large buffer, so a scan costs a
+ * rewind plus a handful of syscalls instead of opendir/readdir/closedir. */
+int procfs_list_pids(procfs_pid_scan *scan) {
+    if (!scan)
+        return -1;
+    if (!scan->buf) {
+        scan->buf = malloc(PID_SCAN_BUF_SIZE);
+        if (!scan->buf)
+            return -1;
+        scan->buf_size = PID_SCAN_BUF_SIZE;
+    }
+    if (scan->dir_fd < 0) {
+        scan->dir_fd = open("/proc", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        if (scan->dir_fd < 0)
+            return -1;
+    } else if (lseek(scan->dir_fd, 0, SEEK_SET) != 0) {
+        close(scan->dir_fd);
+        scan->dir_fd = -1;
+        return -1;
+    }
+
+    scan->count = 0;
+    bool sorted = true;
+    for (;;) {
+        long n = syscall(SYS_getdents64, scan->dir_fd, scan->buf, scan->buf_size);
+        if (n < 0)
+            return -1;
+        if (n == 0)
+            break;
+        for (long off = 0; off < n;) {
+            const struct linux_dirent64 *ent = (const void *)(scan->buf + off);
+            off += ent->d_reclen;
+            if ((ent->d_type != DT_DIR && ent->d_type != DT_UNKNOWN) || !is_digit(ent->d_name[0]))
+                continue;
+            pid_t pid = parse_pid_name(ent->d_name);
+            if (pid <= 0)
+                continue;
+            if (scan->count == scan->capacity) {
+                size_t new_cap = scan->capacity ? scan->capacity * 2 : 1024;
+                pid_t *pids = realloc(scan->pids, new_cap * sizeof(pid_t));
+                if (!pids)
+                    return -1;
+                scan->pids = pids;
+                scan->capacity = new_cap;
+            }
+            if (scan->count > 0 && scan->pids[scan->count - 1] >= pid)
+                sorted = false;
+            scan->pids[scan->count++] = pid;
+        }
+    }
+    /* the kernel lists tasks in PID order, so this is only a safety net */
+    if (!sorted)
+        qsort(scan->pids, scan->count, sizeof(pid_t), pid_order);
+    return 0;
+}
+
+void procfs_diff_pids(const pid_t *old, size_t old_count,
+                      const pid_t *cur, size_t cur_count,
+                      void (*gone)(pid_t pid, void *ctx),
+                      void (*born)(pid_t pid, void *ctx),
+                      void *ctx) {
+    size_t i = 0;
+    size_t j = 0;
+    while (i < old_count || j < cur_count) {
+        if (j == cur_count || (i < old_count && old[i] < cur[j])) {
+            if (gone)
+                gone(old[i], ctx);
+            i++;
+        } else if (i == old_count || cur[j] < old[i]) {
+            if (born)
+                born(cur[j], ctx);
+            j++;
+        } else {
+            i++;
+            j++;
+        }
+    }
+}
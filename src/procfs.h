@@ -0,0 +1,111 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <sys/types.h>
+
+/* Fields cuPID uses from /proc/<pid>/stat. comm points into the parsed
+ * buffer and is not NUL terminated. */
+typedef struct {
+    pid_t pid;
+    const char *comm;
+    size_t comm_len;
+    char state;
+    pid_t ppid;
+    unsigned long long utime;     /* clock ticks */
+    unsigned long long stime;     /* clock ticks */
+    long num_threads;
+    unsigned long long starttime; /* clock ticks after boot */
+    unsigned long long vsize;     /* bytes */
+    long long rss;                /* pages */
+} proc_stat_fields;
+
+// Single pass over a /proc/<pid>/stat line; no allocation, no copies.
+int procfs_parse_stat(const char *buf, size_t len, proc_stat_fields *out);
+
+/* Fields cuPID uses from /proc/<pid>/status. present has a
+ * PROC_STATUS_HAS_* bit for every line that was found. */
+enum {
+    PROC_STATUS_HAS_UID = 1u << 0,
+    PROC_STATUS_HAS_THREADS = 1u << 1,
+    PROC_STATUS_HAS_VMRSS = 1u << 2,
+    PROC_STATUS_HAS_VMSWAP = 1u << 3,
+    PROC_STATUS_HAS_NSPID = 1u << 4,
+    PROC_STATUS_HAS_VCSW = 1u << 5,
+    PROC_STATUS_HAS_NVCSW = 1u << 6,
+};
+
+typedef struct {
+    unsigned int present;
+    unsigned int ruid;
+    unsigned int euid;
+    int threads;
+    long vm_rss_kb;
+    long vm_swap_kb;
+    pid_t nspid;        /* PID in the innermost PID namespace */
+    unsigned long long voluntary_ctxt_switches;
+    unsigned long long nonvoluntary_ctxt_switches;
+} proc_status_fields;
+
+// One pass over a /proc/<pid>/status buffer, matching keys from a table.
+int procfs_parse_status(const char *buf, size_t len, proc_status_fields *out);
+
+/* Totals from /proc/<pid>/smaps_rollup, in kB. USS is private_clean +
+ * private_dirty. */
+typedef struct {
+    long rss_kb;
+    long pss_kb;
+    long private_clean_kb;
+    long private_dirty_kb;
+    long swap_pss_kb;
+} proc_smaps_fields;
+
+// Parses a smaps_rollup buffer; -1 unless it has a Pss line.
+int procfs_parse_smaps_rollup(const char *buf, size_t len, proc_smaps_fields *out);
+
+/* Storage I/O counters from /proc/<pid>/io, in bytes since the process
+ * started. */
+typedef struct {
+    unsigned long long read_bytes;
+    unsigned long long write_bytes;
+    unsigned long long cancelled_write_bytes;
+} proc_io_fields;
+
+// Parses a /proc/<pid>/io buffer; -1 unless all three counters are present.
+int procfs_parse_io(const char *buf, size_t len, proc_io_fields *out);
+
+/* Scheduler statistics of one task from /proc/<pid>/schedstat (or
+ * /proc/<pid>/task/<tid>/schedstat). The file describes a single thread,
+ * not the whole thread group. */
+typedef struct {
+    unsigned long long cpu_ns;      /* time spent on a CPU */
+    unsigned long long runq_ns;     /* time spent runnable, waiting for a CPU */
+    unsigned long long timeslices;
+} proc_schedstat_fields;
+
+// Parses the three numbers of a schedstat line; -1 if any is missing.
+int procfs_parse_schedstat(const char *buf, size_t len, proc_schedstat_fields *out);
+
+/* Reusable state for procfs_list_pids(): the /proc descriptor stays open
+ * and is rewound between scans. */
+typedef struct {
+    int dir_fd;       /* -1 until the first scan */
+    char *buf;        /* getdents64 buffer */
+    size_t buf_size;
+    pid_t *pids;      /* ascending PIDs of the last scan */
+    size_t count;
+    size_t capacity;
+} procfs_pid_scan;
+
+void procfs_pid_scan_init(procfs_pid_scan *scan);
+void procfs_pid_scan_free(procfs_pid_scan *scan);
+
+// Lists the numeric entries of /proc into scan->pids, ascending; 0 or -1.
+int procfs_list_pids(procfs_pid_scan *scan);
+
+// Merge-walks two ascending PID vectors, reporting PIDs only in old or only in cur.
+void procfs_diff_pids(const pid_t *old, size_t old_count,
+                      const pid_t *cur, size_t cur_count,
+                      void (*gone)(pid_t pid, void *ctx),
+                      void (*born)(pid_t pid, void *ctx),
+                      void *ctx);
@@ -0,0 +1,449 @@
+#define _GNU_SOURCE
+
+#include "sampler.h"
+
+#include "filter.h"
+
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <time.h>
+#include <unistd.h>
+
+#define SAMPLER_INDEX 3u  /* low bits of middle: a snapshot index */
+#define SAMPLER_FRESH 4u  /* middle was published after the UI last took it */
+
+#define PACE_QUIET_PASSES 3 /* quiet passes before the period grows */
+#define PACE_INPUT_HOLD 2.0 /* seconds the floor rate outlasts a key press */
+
+#define SLICE_PUBLISH_GAP 0.1 /* seconds between publishes in the middle of a pass */
+#define SLICE_YIELD_MS 1      /* pause between the slices of a pass */
+
+static double monotonic_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+static void signal_fd(int fd) {
+    uint64_t one = 1;
+    /* a full counter already wakes the reader, so a failed write is fine */
+    if (write(fd, &one, sizeof(one)) < 0)
+        return;
+}
+
+static void drain_fd(int fd) {
+    uint64_t count;
+    if (read(fd, &count, sizeof(count)) < 0)
+        return;
+}
+
+static void snapshot_init(sampler_snapshot *snap) {
+    process_list_init(&snap->list);
+    intern_pool_init(&snap->strings);
+    cpu_info_init(&snap->cpu_info);
+    snap->cpu_usage = -1.0;
+    snap->have_cpu_info = false;
+    memset(&snap->mem_info, 0, sizeof(snap->mem_info));
+    snap->have_mem_info = false;
+    snap->failed = false;
+    snap->sequence = 0;
+    snap->tick_lateness = 0.0;
+    snap->tick_lateness_max = 0.0;
+    snap->ticks_missed = 0;
+    snap->refresh_interval = 0.0;
+}
+
+static void snapshot_free(sampler_snapshot *snap) {
+    process_list_free(&snap->list);
+    intern_pool_free(&snap->strings);
+    cpu_info_free(&snap->cpu_info);
+}
+
+/* Copies the sampler's state into the back snapshot and swaps it into the
+ * middle. A copy that runs out of memory is simply not published. */
+static void publish(sampler *s, bool failed) {
+    sampler_snapshot *snap = &s->snapshots[s->back];
+    if (process_list_copy(&snap->list, &s->list) != 0 ||
+        intern_pool_copy(&snap->strings, &s->cache.strings) != 0 ||
+        cpu_info_copy(&snap->cpu_info, &s->cpu_info) != 0)
+        return;
+    snap->list.strings = &snap->strings;
+    snap->cpu_usage = s->cpu_usage;
+    snap->have_cpu_info = s->have_cpu_info;
+    snap->mem_info = s->mem_info;
+    snap->have_mem_info = s->have_mem_info;
+    snap->failed = failed;
+    snap->sequence = ++s->sequence;
+    snap->tick_lateness = s->timer.lateness;
+    snap->tick_lateness_max = s->timer.max_lateness;
+    snap->ticks_missed = s->timer.missed;
+    snap->refresh_interval = s->timer.interval;
+    /* the exchange releases the copy to whoever takes the middle next */
+    unsigned int old = atomic_exchange_explicit(&s->middle, s->back | SAMPLER_FRESH,
+                                                memory_order_acq_rel);
+    s->back = old & SAMPLER_INDEX;
+    signal_fd(s->notify_fd);
+}
+
+static void read_panels(sampler *s) {
+    if (s->config->show_cpu_panel) {
+        s->cpu_usage = read_cpu_usage_percent();
+        if (read_full_cpu_info(&s->cpu_info) == 0)
+            s->have_cpu_info = true;
+    }
+    if (s->config->show_memory_panel && read_full_mem_info(&s->mem_info))
+        s->have_mem_info = true;
+}
+
+/* Moves the period to interval, kept within the adaptive bounds. Without
+ * refresh_adaptive both bounds are refresh_rate, so nothing moves. */
+static void pace_set(sampler *s, double interval) {
+    if (interval < s->pace_min)
+        interval = s->pace_min;
+    if (interval > s->pace_max)
+        interval = s->pace_max;
+    if (interval != s->timer.interval)
+        tick_timer_set_interval(&s->timer, interval);
+}
+
+static double distance(double a, double b) {
+    return a > b ? a - b : b - a;
+}
+
+/* How far the pass just published moved from the one before, in
+ * percentage points: the summed CPU% of the listed processes relative to
+ * the whole machine, the largest change of a single core, and the share
+ * of processes that started or exited. Remembers this pass.
+ *
+ * CPU% is counted in clock ticks, so the difference of two readings may
+ * be two ticks off. That much is noise, and a lot of it at short periods
+ * (20 points at 100 ms), which would otherwise keep the rate at the floor. */
+static double pace_change(sampler *s) {
+    const process_list *list = &s->list;
+    double load = 0.0;
+    for (size_t row = 0; row < list->rows; ++row) {
+        if (list->detail[row].generation != 0)
+            load += list->detail[row].cpu_own;
+    }
+    double change = distance(load, s->pace_load) / s->pace_cpus;
+    s->pace_load = load;
+
+    int cores = s->have_cpu_info && s->cpu_info.core_usage ? s->cpu_info.logical_cores : 0;
+    if (cores != s->pace_core_count) {
+        /* hotplug or the first reading: nothing to compare against yet */
+        double *resized = cores > 0 ? realloc(s->pace_cores, (size_t)cores * sizeof(double)) : NULL;
+        if (!resized) {
+            free(s->pace_cores);
+            cores = 0;
+        }
+        s->pace_cores = resized;
+        s->pace_core_count = cores;
+        if (cores > 0)
+            memcpy(s->pace_cores, s->cpu_info.core_usage, (size_t)cores * sizeof(double));
+        cores = 0;
+    }
+    for (int i = 0; i < cores; ++i) {
+        if (distance(s->cpu_info.core_usage[i], s->pace_cores[i]) > change)
+            change = distance(s->cpu_info.core_usage[i], s->pace_cores[i]);
+        s->pace_cores[i] = s->cpu_info.core_usage[i];
+    }
+    change -= 2.0 * 100.0 / (s->pace_hz * s->timer.interval);
+
+    size_t churn = s->cache.pass_born + s->cache.pass_exited;
+    if (s->cache.count > 0 && 100.0 * (double)churn / (double)s->cache.count > change)
+        change = 100.0 * (double)churn / (double)s->cache.count;
+    return change;
+}
+
+/* refresh_adaptive, after each complete pass: faster while things move or
+ * the user is at the keys, slower once the system has been quiet. */
+static void pace_after_pass(sampler *s) {
+    double change = pace_change(s);
+    if (!s->pace_primed) {
+        s->pace_primed = true;
+        return;
+    }
+    if (monotonic_seconds() - s->pace_input_at < PACE_INPUT_HOLD) {
+        s->pace_quiet = 0;
+        pace_set(s, s->pace_min);
+    } else if (change >= (double)s->config->refresh_change_threshold) {
+        s->pace_quiet = 0;
+        pace_set(s, s->timer.interval / 2.0);
+    } else if (++s->pace_quiet >= PACE_QUIET_PASSES) {
+        s->pace_quiet = 0;
+        pace_set(s, s->timer.interval * 1.5);
+    }
+}
+
+static void *sampler_main(void *arg) {
+    sampler *s = arg;
+    const cupid_config *config = s->config;
+    char filter[sizeof(s->filter)];
+    bool due = true; /* the first pass starts at once, the timer paces the rest */
+    bool hidden = false;
+    bool refiltered = false; /* the pass under way runs with a new filter */
+    double published_at = 0.0;
+    struct pollfd fds[2] = {
+        {.fd = s->wake_fd, .events = POLLIN},
+        {.fd = s->timer.fd, .events = POLLIN},
+    };
+
+    for (;;) {
+        pthread_mutex_lock(&s->lock);
+        bool stop = s->stop;
+        bool filter_changed = s->filter_pending;
+        if (filter_changed) {
+            memcpy(filter, s->filter, sizeof(filter));
+            s->filter_pending = false;
+        }
+        bool input = s->input_pending;
+        s->input_pending = false;
+        bool hide = s->hidden;
+        pthread_mutex_unlock(&s->lock);
+        if (stop)
+            break;
+
+        if (hide != hidden) {
+            hidden = hide;
+            /* out of focus the list keeps moving at the slowest pace, with
+             * the costly reads left out; focus again counts as input */
+            process_cache_set_background(&s->cache, hidden);
+            if (hidden) {
+                pace_set(s, s->pace_max);
+            } else {
+                input = true;
+                due = true;
+            }
+        }
+        if (input && !hidden) {
+            s->pace_input_at = monotonic_seconds();
+            pace_set(s, s->pace_min);
+        }
+
+        /* sampler_set_filter() compiled it once already */
+        if (filter_changed) {
+            process_cache_set_filter(&s->cache, filter, NULL, 0);
+            refiltered = true;
+        }
+        process_cache_set_visible_rows(&s->cache, atomic_load(&s->visible_rows));
+
+        /* An incremental scan (scan_slice_ms) runs a slice per round */
+        bool scanning = process_cache_scan_pending(&s->cache);
+        if (filter_changed || scanning || due) {
+            /* Passes start on ticks; one that already expired (focus came
+             * back, which also moves the pace) belongs to this pass */
+            if (!scanning) {
+                due = false;
+                tick_timer_take(&s->timer);
+            }
+            bool failed = process_list_refresh(&s->list, &s->cache, config) != 0;
+            /* The panels and the pace follow whole passes: the churn
+             * counters cover a pass only once its last slice swept the cache */
+            if (!process_cache_scan_pending(&s->cache)) {
+                read_panels(s);
+                /* a new filter changes the list, not the system */
+                if (refiltered)
+                    s->pace_primed = false;
+                refiltered = false;
+                if (config->refresh_adaptive && !failed && !hidden)
+                    pace_after_pass(s);
+            }
+            /* every copy is O(rows), so slices publish at most every
+             * SLICE_PUBLISH_GAP; the end of a pass always does */
+            double now = monotonic_seconds();
+            if (!process_cache_scan_pending(&s->cache) || failed || filter_changed ||
+                now - published_at >= SLICE_PUBLISH_GAP) {
+                publish(s, failed);
+                published_at = now;
+            }
+        }
+
+        /* Sleep until the next tick or request; between slices only briefly,
+         * so a sliced pass leaves the CPU to others now and then. A tick
+         * that expires mid-pass starts the next pass right after. */
+        int wait_ms = process_cache_scan_pending(&s->cache) ? SLICE_YIELD_MS : -1;
+        if (poll(fds, 2, wait_ms) < 0 && errno != EINTR)
+            break;
+        if (fds[0].revents & POLLIN)
+            drain_fd(s->wake_fd);
+        if ((fds[1].revents & POLLIN) && tick_timer_take(&s->timer))
+            due = true;
+    }
+    return NULL;
+}
+
+/* Frees what sampler_start() set up, once the thread is gone. */
+static void sampler_release(sampler *s) {
+    tick_timer_close(&s->timer);
+    free(s->pace_cores);
+    s->pace_cores = NULL;
+    if (s->wake_fd >= 0)
+        close(s->wake_fd);
+    if (s->notify_fd >= 0)
+        close(s->notify_fd);
+    s->wake_fd = -1;
+    s->notify_fd = -1;
+    pthread_mutex_destroy(&s->lock);
+    for (int i = 0; i < 3; ++i)
+        snapshot_free(&s->snapshots[i]);
+    cpu_info_free(&s->cpu_info);
+    process_list_free(&s->list);
+    process_cache_free(&s->cache);
+}
+
+int sampler_start(sampler *s, const cupid_config *config, char *err, size_t errlen) {
+    if (!s || !config)
+        return -1;
+    s->config = config;
+    s->running = false;
+    process_cache_init(&s->cache);
+    process_list_init(&s->list);
+    s->cpu_usage = -1.0;
+    cpu_info_init(&s->cpu_info);
+    s->have_cpu_info = false;
+    memset(&s->mem_info, 0, sizeof(s->mem_info));
+    s->have_mem_info = false;
+    s->sequence = 0;
+    for (int i = 0; i < 3; ++i)
+        snapshot_init(&s->snapshots[i]);
+    atomic_init(&s->middle, 1u);
+    s->back = 2;
+    s->front = 0;
+    s->have_front = false;
+    s->stop = false;
+    s->filter_pending = false;
+    s->filter[0] = '\0';
+    s->hidden = false;
+    s->input_pending = false;
+    atomic_init(&s->visible_rows, 0);
+
+    /* applied before the thread starts, so the first pass is filtered */
+    process_cache_set_filter(&s->cache, config->default_filter, err, errlen);
+
+    double interval = (config->refresh_rate_ms > 50
+                       ? (double)config->refresh_rate_ms
+                       : 50.0) / 1000.0;
+    s->pace_min = interval;
+    s->pace_max = interval;
+    if (config->refresh_adaptive) {
+        s->pace_min = (double)config->refresh_min_ms / 1000.0;
+        s->pace_max = (double)config->refresh_max_ms / 1000.0;
+        if (s->pace_max < s->pace_min)
+            s->pace_max = s->pace_min;
+        /* refresh_rate is where it starts */
+        if (interval < s->pace_min)
+            interval = s->pace_min;
+        if (interval > s->pace_max)
+            interval = s->pace_max;
+    }
+    s->pace_load = 0.0;
+    s->pace_cores = NULL;
+    s->pace_core_count = 0;
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    s->pace_cpus = cpus > 0 ? (int)cpus : 1;
+    long hz = sysconf(_SC_CLK_TCK);
+    s->pace_hz = hz > 0 ? (double)hz : 100.0;
+    s->pace_quiet = 0;
+    s->pace_primed = false;
+    s->pace_input_at = 0.0;
+    s->wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    s->notify_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    s->timer.fd = -1;
+    pthread_mutex_init(&s->lock, NULL);
+    if (s->wake_fd < 0 || s->notify_fd < 0 || tick_timer_open(&s->timer, interval) != 0) {
+        sampler_release(s);
+        return -1;
+    }
+    /* The thread inherits the mask, so terminal signals (SIGWINCH, SIGTSTP)
+     * and their ncurses handlers stay on the UI thread */
+    sigset_t all, saved;
+    sigfillset(&all);
+    pthread_sigmask(SIG_BLOCK, &all, &saved);
+    int created = pthread_create(&s->thread, NULL, sampler_main, s);
+    pthread_sigmask(SIG_SETMASK, &saved, NULL);
+    if (created != 0) {
+        sampler_release(s);
+        return -1;
+    }
+    s->running = true;
+    return 0;
+}
+
+void sampler_stop(sampler *s) {
+    if (!s || !s->running)
+        return;
+    pthread_mutex_lock(&s->lock);
+    s->stop = true;
+    pthread_mutex_unlock(&s->lock);
+    signal_fd(s->wake_fd);
+    pthread_join(s->thread, NULL);
+    s->running = false;
+    sampler_release(s);
+}
+
+sampler_snapshot *sampler_acquire(sampler *s, bool *fresh) {
+    bool changed = false;
+    /* before looking at middle, so a publish after the look still wakes poll() */
+    drain_fd(s->notify_fd);
+    if (atomic_load_explicit(&s->middle, memory_order_relaxed) & SAMPLER_FRESH) {
+        /* hand back the front snapshot, including any reordering */
+        unsigned int old = atomic_exchange_explicit(&s->middle, s->front, memory_order_acq_rel);
+        s->front = old & SAMPLER_INDEX;
+        s->have_front = true;
+        changed = true;
+    }
+    if (fresh)
+        *fresh = changed;
+    return s->have_front ? &s->snapshots[s->front] : NULL;
+}
+
+int sampler_set_filter(sampler *s, const char *expr, char *err, size_t errlen) {
+    if (!s)
+        return -1;
+    if (err && errlen > 0)
+        err[0] = '\0';
+    /* compile here too, so that errors reach the prompt right away */
+    if (expr && expr[strspn(expr, " \t")] != '\0') {
+        process_filter *filter = filter_compile(expr, err, errlen);
+        if (!filter)
+            return -1;
+        filter_free(filter);
+    }
+    pthread_mutex_lock(&s->lock);
+    snprintf(s->filter, sizeof(s->filter), "%s", expr ? expr : "");
+    s->filter_pending = true;
+    pthread_mutex_unlock(&s->lock);
+    signal_fd(s->wake_fd);
+    return 0;
+}
+
+void sampler_set_visible_rows(sampler *s, size_t rows) {
+    if (s)
+        atomic_store(&s->visible_rows, rows);
+}
+
+void sampler_note_input(sampler *s) {
+    if (!s || !s->config->refresh_adaptive)
+        return;
+    pthread_mutex_lock(&s->lock);
+    s->input_pending = true;
+    pthread_mutex_unlock(&s->lock);
+    signal_fd(s->wake_fd);
+}
+
+void sampler_set_hidden(sampler *s, bool hidden) {
+    if (!s)
+        return;
+    pthread_mutex_lock(&s->lock);
+    bool changed = s->hidden != hidden;
+    s->hidden = hidden;
+    pthread_mutex_unlock(&s->lock);
+    if (changed)
+        signal_fd(s->wake_fd);
+}
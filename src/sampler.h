@@ -0,0 +1,123 @@
+#pragma once
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "config.h"
+#include "cpu.h"
+#include "intern.h"
+#include "memory.h"
+#include "process.h"
+#include "tick_timer.h"
+
+/* Everything the UI draws from one refresh. A published snapshot belongs
+ * to the UI until it acquires the next one. The UI may sort more of it
+ * with process_list_ensure_sorted(), which rewrites list.order and
+ * list.sorted and relinks the tree (first_child, next_sibling, and parent
+ * for rows cut by max_processes). The sampler never reads a snapshot it
+ * handed over: it only writes the back one, and process_list_copy()
+ * replaces all of those fields when that buffer comes back to it.
+ * list.strings points at strings below, a private copy of the cache's
+ * pool, so the sampler can keep interning. */
+typedef struct {
+    process_list list;
+    intern_pool strings;
+    double cpu_usage;     /* -1 until the CPU panel was read */
+    cpu_info_t cpu_info;
+    bool have_cpu_info;
+    mem_info_t mem_info;
+    bool have_mem_info;
+    bool failed;          /* the refresh could not read the process list */
+    unsigned long sequence;
+    double tick_lateness; /* seconds the last pass started after its deadline */
+    double tick_lateness_max;
+    unsigned long ticks_missed; /* passes skipped because one ran past the next */
+    double refresh_interval; /* seconds between passes, moved by refresh_adaptive */
+} sampler_snapshot;
+
+/* Refreshes the process list and panels on a thread of its own and hands
+ * each result to the UI through a triple buffer: the sampler fills the
+ * back snapshot, then swaps it with the middle one; the UI swaps the
+ * middle one with its front snapshot when a newer one is there. Neither
+ * side waits for the other.
+ *
+ * The thread sleeps in poll() on a tick_timer and a wake eventfd, so it
+ * runs once per refresh_rate and whenever the UI asks for something.
+ * notify_fd becomes readable after each publish, for the UI's poll().
+ *
+ * With refresh_adaptive the period moves between refresh_min_ms and
+ * refresh_max_ms: it halves after a pass that saw the process list or a
+ * core change by refresh_change_threshold points, grows by half after a
+ * few quiet ones, and drops to the floor while the user is at the keys.
+ * While the terminal is out of focus the passes run at refresh_max_ms and
+ * skip the costly reads (see process_cache_set_background()). */
+typedef struct {
+    const cupid_config *config; /* read only, shared with the UI */
+    pthread_t thread;
+    bool running;
+    int wake_fd;                 /* eventfd, UI -> sampler */
+    int notify_fd;               /* eventfd, sampler -> UI */
+
+    /* sampler thread only */
+    process_cache cache;
+    process_list list;
+    double cpu_usage;
+    cpu_info_t cpu_info;
+    bool have_cpu_info;
+    mem_info_t mem_info;
+    bool have_mem_info;
+    unsigned long sequence;
+    tick_timer timer;
+    double pace_min;             /* refresh_adaptive bounds, seconds */
+    double pace_max;
+    double pace_load;            /* summed CPU% of the listed processes, last pass */
+    double *pace_cores;          /* per-core usage of the last pass */
+    int pace_core_count;
+    int pace_cpus;               /* online CPUs, scales pace_load */
+    double pace_hz;              /* clock ticks per second, the CPU% resolution */
+    int pace_quiet;              /* quiet passes in a row */
+    bool pace_primed;            /* pace_load and pace_cores hold a pass */
+    double pace_input_at;        /* when the UI last reported input */
+
+    sampler_snapshot snapshots[3];
+    atomic_uint middle;          /* index of the middle snapshot, plus SAMPLER_FRESH */
+    unsigned int back;           /* sampler side */
+    unsigned int front;          /* UI side */
+    bool have_front;
+
+    /* requests from the UI, under lock and followed by a write to wake_fd */
+    pthread_mutex_t lock;
+    bool stop;
+    bool filter_pending;
+    char filter[128];
+    bool hidden;
+    bool input_pending;
+    atomic_size_t visible_rows;
+} sampler;
+
+// Start sampling with config, which must outlive the sampler; 0 or -1.
+// A default_filter that does not compile is described in err and ignored.
+int sampler_start(sampler *s, const cupid_config *config, char *err, size_t errlen);
+void sampler_stop(sampler *s);
+
+// Newest snapshot, or NULL before the first one. *fresh tells whether it
+// changed since the last call. Valid until the next call; never blocks.
+// Also clears notify_fd.
+sampler_snapshot *sampler_acquire(sampler *s, bool *fresh);
+
+// Validate expr and have the sampler apply it and refresh right away.
+// Returns -1 and describes the problem in err when it does not compile.
+int sampler_set_filter(sampler *s, const char *expr, char *err, size_t errlen);
+
+// Tell the sampler how many leading rows the UI needs in order.
+void sampler_set_visible_rows(sampler *s, size_t rows);
+
+// With refresh_adaptive: the user pressed a key, so keep the floor rate
+// for a while.
+void sampler_note_input(sampler *s);
+
+// With refresh_adaptive: while nobody looks, refresh at refresh_max_ms and
+// skip the costly reads. The first pass after the UI shows again starts at once.
+void sampler_set_hidden(sampler *s, bool hidden);
@@ -0,0 +1,90 @@
+#define _GNU_SOURCE
+
+#include "tick_timer.h"
+
+#include <stdint.h>
+#include <sys/timerfd.h>
+#include <time.h>
+#include <unistd.h>
+
+static double monotonic_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+static struct timespec to_timespec(double seconds) {
+    struct timespec ts;
+    ts.tv_sec = (time_t)seconds;
+    ts.tv_nsec = (long)((seconds - (double)ts.tv_sec) * 1e9);
+    if (ts.tv_nsec >= 1000000000L)
+        ts.tv_nsec = 999999999L;
+    return ts;
+}
+
+int tick_timer_open(tick_timer *timer, double interval) {
+    if (!timer || interval <= 0.0)
+        return -1;
+    timer->fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (timer->fd < 0)
+        return -1;
+    timer->interval = interval;
+    timer->deadline = monotonic_seconds() + interval;
+    timer->lateness = 0.0;
+    timer->max_lateness = 0.0;
+    timer->ticks = 0;
+    timer->missed = 0;
+
+    /* an absolute first expiry keeps deadline in step with the kernel's */
+    struct itimerspec spec;
+    spec.it_value = to_timespec(timer->deadline);
+    spec.it_interval = to_timespec(interval);
+    if (timerfd_settime(timer->fd, TFD_TIMER_ABSTIME, &spec, NULL) != 0) {
+        close(timer->fd);
+        timer->fd = -1;
+        return -1;
+    }
+    return 0;
+}
+
+int tick_timer_set_interval(tick_timer *timer, double interval) {
+    if (!timer || timer->fd < 0 || interval <= 0.0)
+        return -1;
+    double deadline = timer->deadline - timer->interval + interval;
+    double now = monotonic_seconds();
+    if (deadline < now)
+        deadline = now;
+
+    struct itimerspec spec;
+    spec.it_value = to_timespec(deadline);
+    spec.it_interval = to_timespec(interval);
+    if (timerfd_settime(timer->fd, TFD_TIMER_ABSTIME, &spec, NULL) != 0)
+        return -1;
+    timer->interval = interval;
+    timer->deadline = deadline;
+    return 0;
+}
+
+void tick_timer_close(tick_timer *timer) {
+    if (!timer || timer->fd < 0)
+        return;
+    close(timer->fd);
+    timer->fd = -1;
+}
+
+bool tick_timer_take(tick_timer *timer) {
+    uint64_t expirations = 0;
+    if (!timer || timer->fd < 0 ||
+        read(timer->fd, &expirations, sizeof(expirations)) != (ssize_t)sizeof(expirations) ||
+        expirations == 0)
+        return false;
+    /* measured against the newest deadline that passed */
+    double due = timer->deadline + (double)(expirations - 1) * timer->interval;
+    timer->lateness = monotonic_seconds() - due;
+    if (timer->lateness > timer->max_lateness)
+        timer->max_lateness = timer->lateness;
+    timer->deadline = due + timer->interval;
+    timer->ticks++;
+    timer->missed += expirations - 1;
+    return true;
+}
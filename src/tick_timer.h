@@ -0,0 +1,29 @@
+#pragma once
+
+#include <stdbool.h>
+
+/* Periodic CLOCK_MONOTONIC timer on a timerfd, for poll() loops. Ticks
+ * fall on fixed deadlines (start + n * interval), so a slow tick delays
+ * nothing after it and the cadence does not drift. Expirations that pass
+ * while the owner is busy are merged into one tick and counted. */
+typedef struct {
+    int fd;                  /* -1 when closed; poll it for POLLIN */
+    double interval;         /* seconds */
+    double deadline;         /* CLOCK_MONOTONIC seconds of the next tick */
+    double lateness;         /* how long after its deadline the last tick was taken */
+    double max_lateness;
+    unsigned long ticks;
+    unsigned long missed;    /* expirations merged into a later tick */
+} tick_timer;
+
+// First tick one interval after now; returns 0 or -1.
+int tick_timer_open(tick_timer *timer, double interval);
+void tick_timer_close(tick_timer *timer);
+
+// Change the period. The next tick moves to the last one plus the new
+// interval, or to now when that has passed already; 0 or -1.
+int tick_timer_set_interval(tick_timer *timer, double interval);
+
+// Consume the expirations behind a POLLIN and record the lateness.
+// Returns false when nothing had expired after all.
+bool tick_timer_take(tick_timer *timer);